@@ -0,0 +1,312 @@
+//
+// Created by Supradeep Chitumalla on 16/10/26.
+//
+
+#ifndef BASELINE_QUEUES_H
+#define BASELINE_QUEUES_H
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Reference queues used by the comparison benchmark. They all expose the same
+// push(T) / std::unique_ptr<T> pop() surface as lock_free_queue, plus a
+// try_pop(T&) that does not allocate, so the harness can drive every queue
+// through identical code.
+
+template <typename T>
+class mutex_deque_queue {
+private:
+    std::mutex m;
+    std::deque<T> items;
+
+public:
+    void push(T new_value) {
+        std::lock_guard<std::mutex> lock(m);
+        items.push_back(std::move(new_value));
+    }
+
+    bool try_pop(T& out) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) {
+            return false;
+        }
+        out = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    std::unique_ptr<T> pop() {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) {
+            return std::unique_ptr<T>();
+        }
+        std::unique_ptr<T> res(new T(std::move(items.front())));
+        items.pop_front();
+        return res;
+    }
+};
+
+// Same as mutex_deque_queue, but consumers park on a condition variable instead
+// of spinning when the queue is empty.
+template <typename T>
+class mutex_condvar_queue {
+private:
+    std::mutex m;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+
+public:
+    void push(T new_value) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            items.push_back(std::move(new_value));
+        }
+        not_empty.notify_one();
+    }
+
+    bool try_pop(T& out) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) {
+            return false;
+        }
+        out = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    template <typename Rep, typename Period>
+    bool pop_wait_for(T& out, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock<std::mutex> lock(m);
+        if (!not_empty.wait_for(lock, timeout, [this] { return !items.empty(); })) {
+            return false;
+        }
+        out = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    std::unique_ptr<T> pop() {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) {
+            return std::unique_ptr<T>();
+        }
+        std::unique_ptr<T> res(new T(std::move(items.front())));
+        items.pop_front();
+        return res;
+    }
+};
+
+// Michael & Scott two-lock queue: a dummy node separates head and tail so that
+// one producer and one consumer never contend on the same lock.
+template <typename T>
+class two_lock_queue {
+private:
+    struct node {
+        std::unique_ptr<T> data;
+        std::atomic<node*> next{nullptr};
+    };
+
+    std::mutex head_mutex;
+    node* head;
+    std::mutex tail_mutex;
+    node* tail;
+
+public:
+    two_lock_queue() : head(new node), tail(head) {}
+
+    two_lock_queue(const two_lock_queue&) = delete;
+    two_lock_queue& operator=(const two_lock_queue&) = delete;
+
+    ~two_lock_queue() {
+        while (head) {
+            node* const old_head = head;
+            head = old_head->next.load(std::memory_order_relaxed);
+            delete old_head;
+        }
+    }
+
+    void push(T new_value) {
+        std::unique_ptr<T> new_data(new T(std::move(new_value)));
+        node* const new_node = new node;
+        std::lock_guard<std::mutex> lock(tail_mutex);
+        tail->data = std::move(new_data);
+        tail->next.store(new_node, std::memory_order_release);
+        tail = new_node;
+    }
+
+    std::unique_ptr<T> pop() {
+        node* old_head;
+        {
+            std::lock_guard<std::mutex> lock(head_mutex);
+            node* const next = head->next.load(std::memory_order_acquire);
+            if (!next) {
+                return std::unique_ptr<T>();
+            }
+            old_head = head;
+            head = next;
+        }
+        std::unique_ptr<T> res = std::move(old_head->data);
+        delete old_head;
+        return res;
+    }
+
+    bool try_pop(T& out) {
+        std::unique_ptr<T> res = pop();
+        if (!res) {
+            return false;
+        }
+        out = std::move(*res);
+        return true;
+    }
+};
+
+// Dmitry Vyukov's bounded MPMC queue. Each cell carries a sequence number that
+// tells producers and consumers whose turn it is, so the only shared writes are
+// the two position counters and the cell itself.
+template <typename T>
+class vyukov_bounded_queue {
+private:
+    struct cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    static constexpr std::size_t cache_line = 64;
+
+    std::vector<cell> buffer;
+    std::size_t const mask;
+    alignas(cache_line) std::atomic<std::size_t> enqueue_pos{0};
+    alignas(cache_line) std::atomic<std::size_t> dequeue_pos{0};
+
+public:
+    explicit vyukov_bounded_queue(std::size_t capacity = 1 << 16)
+        : buffer(capacity), mask(capacity - 1) {
+        // Positions wrap with a mask, so the capacity must be a power of two.
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("vyukov_bounded_queue capacity must be a power of two");
+        }
+        for (std::size_t i = 0; i < capacity; ++i) {
+            buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Only moves from new_value once a cell has been claimed, so a failed
+    // attempt leaves the caller's value intact.
+    bool try_push(T&& new_value) {
+        std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &buffer[pos & mask];
+            std::size_t const seq = c->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = std::move(new_value);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking push so the queue can stand in for the unbounded ones.
+    void push(T new_value) {
+        while (!try_push(std::move(new_value))) {
+            std::this_thread::yield();
+        }
+    }
+
+    bool try_pop(T& out) {
+        std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;) {
+            c = &buffer[pos & mask];
+            std::size_t const seq = c->sequence.load(std::memory_order_acquire);
+            auto const diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        out = std::move(c->data);
+        c->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::unique_ptr<T> pop() {
+        T value;
+        if (!try_pop(value)) {
+            return std::unique_ptr<T>();
+        }
+        return std::unique_ptr<T>(new T(std::move(value)));
+    }
+};
+
+// Reference for relaxed_priority_queue: std::priority_queue behind one mutex,
+// with the same push(priority, value) / pop_min surface. Pops are exact.
+template <typename T, typename Priority = std::uint64_t>
+class mutex_priority_queue {
+private:
+    struct entry {
+        Priority priority;
+        T value;
+
+        bool operator<(const entry& other) const { return priority > other.priority; }
+    };
+
+    std::mutex m;
+    std::priority_queue<entry> items;
+
+public:
+    void push(Priority priority, T value) {
+        std::lock_guard<std::mutex> lock(m);
+        items.push(entry{priority, std::move(value)});
+    }
+
+    bool pop_min(Priority& priority, T& out) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) {
+            return false;
+        }
+        priority = items.top().priority;
+        out = items.top().value;
+        items.pop();
+        return true;
+    }
+
+    bool pop_min(T& out) {
+        Priority priority;
+        return pop_min(priority, out);
+    }
+
+    std::optional<std::pair<Priority, T>> pop_min() {
+        std::pair<Priority, T> item;
+        if (!pop_min(item.first, item.second)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+};
+
+#endif //BASELINE_QUEUES_H
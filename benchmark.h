@@ -0,0 +1,490 @@
+//
+// Created by Supradeep Chitumalla on 16/10/26.
+//
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spin_wait.h"
+#include "topology.h"
+#include "workload.h"
+
+// Every consumer appends what it pops to its own preallocated log, so the timed
+// loop touches no shared state besides the queue. Logs are checked after the
+// threads have joined.
+struct alignas(64) pop_log {
+    std::vector<int> values;
+    long long empty_pops = 0;
+
+    void reserve(std::size_t capacity) { values.reserve(capacity); }
+    void record(int value) { values.push_back(value); }
+};
+
+struct verification_result {
+    std::size_t total_pops = 0;
+    std::size_t unique_values = 0;
+    std::size_t duplicates = 0;
+    std::size_t out_of_range = 0;
+    std::size_t fifo_violations = 0;
+    long long empty_pops = 0;
+
+    bool ok(std::size_t expected, bool require_fifo = true) const {
+        return total_pops == expected && unique_values == expected &&
+               duplicates == 0 && out_of_range == 0 && (!require_fifo || fifo_violations == 0);
+    }
+};
+
+// Producer p pushes p * items_per_producer + i for i in [0, items_per_producer).
+// A FIFO queue must hand each consumer the items of any one producer in the
+// order that producer pushed them, which is what the per-consumer scan checks.
+inline verification_result verify_pop_logs(const std::vector<pop_log>& logs,
+                                           int num_producers, int items_per_producer) {
+    verification_result result;
+    std::size_t const total = static_cast<std::size_t>(num_producers) * items_per_producer;
+    std::vector<unsigned char> seen(total, 0);
+    for (const auto& log : logs) {
+        result.empty_pops += log.empty_pops;
+        result.total_pops += log.values.size();
+        std::vector<int> last_seq(num_producers, -1);
+        for (int value : log.values) {
+            if (value < 0 || static_cast<std::size_t>(value) >= total) {
+                ++result.out_of_range;
+                continue;
+            }
+            if (seen[value]) {
+                ++result.duplicates;
+            } else {
+                seen[value] = 1;
+                ++result.unique_values;
+            }
+            int const producer = value / items_per_producer;
+            int const seq = value % items_per_producer;
+            if (seq <= last_seq[producer]) {
+                ++result.fifo_violations;
+            }
+            last_seq[producer] = seq;
+        }
+    }
+    return result;
+}
+
+// Shared workload description so every queue in a comparison sees exactly the
+// same producer/consumer mix and item count.
+struct mpmc_workload {
+    int num_producers = 4;
+    int num_consumers = 4;
+    int items_per_producer = 250000;
+    // Optional CPU for each producer/consumer; empty leaves threads unpinned.
+    std::vector<int> producer_cpus;
+    std::vector<int> consumer_cpus;
+    // Off for queues that do not promise FIFO order, e.g. priority queues;
+    // loss and duplication are still checked.
+    bool fifo_order = true;
+
+    int total_items() const { return num_producers * items_per_producer; }
+};
+
+struct throughput_result {
+    std::string name;
+    double elapsed_ms = 0;
+    double ops_per_second = 0;
+    long long empty_pops = 0;
+    bool verified = false;
+    int pin_failures = 0;
+};
+
+// Pops without allocating when the queue offers try_pop(T&), and falls back to
+// the unique_ptr interface otherwise. Queues that can park a consumer get a
+// short timed wait instead of a failed pop.
+template <typename Queue, typename T>
+bool bench_pop(Queue& queue, T& out) {
+    if constexpr (requires { queue.pop_wait_for(out, std::chrono::milliseconds(1)); }) {
+        return queue.pop_wait_for(out, std::chrono::milliseconds(1));
+    } else if constexpr (requires { queue.try_pop(out); }) {
+        return queue.try_pop(out);
+    } else {
+        auto result = queue.pop();
+        if (!result) {
+            return false;
+        }
+        out = std::move(*result);
+        return true;
+    }
+}
+
+template <typename Queue>
+throughput_result run_mpmc_throughput(const std::string& name, const mpmc_workload& workload) {
+    Queue queue;
+    std::atomic<bool> start{false};
+    std::atomic<bool> producers_done{false};
+    std::atomic<int> pin_failures{0};
+    auto pin = [&pin_failures](const std::vector<int>& cpus, int index) {
+        if (!cpus.empty() && !pin_current_thread(cpus[index % cpus.size()])) {
+            pin_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    std::vector<pop_log> logs(workload.num_consumers);
+    for (auto& log : logs) {
+        log.reserve(workload.total_items());
+    }
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < workload.num_producers; ++p) {
+        producers.emplace_back([&queue, &start, &workload, &pin, p]() {
+            pin(workload.producer_cpus, p);
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            int const first = p * workload.items_per_producer;
+            for (int i = 0; i < workload.items_per_producer; ++i) {
+                queue.push(first + i);
+            }
+        });
+    }
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < workload.num_consumers; ++c) {
+        consumers.emplace_back([&queue, &start, &producers_done, &workload, &pin, c, &log = logs[c]]() {
+            pin(workload.consumer_cpus, c);
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            int value;
+            for (;;) {
+                // Read the flag before popping: an empty pop after every
+                // producer has finished means the queue really is drained.
+                bool const done = producers_done.load(std::memory_order_acquire);
+                if (bench_pop(queue, value)) {
+                    log.record(value);
+                } else if (done) {
+                    break;
+                } else {
+                    ++log.empty_pops;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    auto const start_time = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    producers_done.store(true, std::memory_order_release);
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    auto const end_time = std::chrono::steady_clock::now();
+
+    verification_result const check =
+        verify_pop_logs(logs, workload.num_producers, workload.items_per_producer);
+
+    throughput_result result;
+    result.name = name;
+    result.elapsed_ms = std::chrono::duration<double, std::milli>(end_time - start_time).count();
+    result.ops_per_second = workload.total_items() * 1000.0 / result.elapsed_ms;
+    result.empty_pops = check.empty_pops;
+    result.verified = check.ok(workload.total_items(), workload.fifo_order);
+    result.pin_failures = pin_failures.load();
+    return result;
+}
+
+// Prints one row per queue; the first row is the baseline the others are
+// compared against.
+inline void print_throughput_table(const std::vector<throughput_result>& results) {
+    if (results.empty()) {
+        return;
+    }
+    double const baseline = results.front().ops_per_second;
+    std::cout << std::left << std::setw(24) << "queue"
+              << std::right << std::setw(12) << "time (ms)"
+              << std::setw(14) << "Mops/s"
+              << std::setw(14) << "empty pops"
+              << std::setw(12) << "vs first"
+              << std::setw(10) << "check" << std::endl;
+    for (const auto& r : results) {
+        std::cout << std::left << std::setw(24) << r.name
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.elapsed_ms
+                  << std::setprecision(3)
+                  << std::setw(14) << r.ops_per_second / 1e6
+                  << std::setw(14) << r.empty_pops
+                  << std::setprecision(2)
+                  << std::setw(11) << r.ops_per_second / baseline << "x"
+                  << std::setw(10) << (r.verified ? "ok" : "FAILED");
+        if (r.pin_failures) {
+            std::cout << "  (" << r.pin_failures << " threads not pinned)";
+        }
+        std::cout << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+struct latency_summary {
+    std::size_t count = 0;
+    double mean_ns = 0;
+    std::uint64_t min_ns = 0;
+    std::uint64_t p50_ns = 0;
+    std::uint64_t p90_ns = 0;
+    std::uint64_t p99_ns = 0;
+    std::uint64_t p999_ns = 0;
+    std::uint64_t max_ns = 0;
+};
+
+// Sorts the samples in place.
+inline latency_summary summarize_latencies(std::vector<std::uint64_t>& samples) {
+    latency_summary summary;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto at = [&samples](double q) {
+        std::size_t const index = static_cast<std::size_t>(q * (samples.size() - 1));
+        return samples[index];
+    };
+    double total = 0;
+    for (std::uint64_t sample : samples) {
+        total += static_cast<double>(sample);
+    }
+    summary.count = samples.size();
+    summary.mean_ns = total / samples.size();
+    summary.min_ns = samples.front();
+    summary.p50_ns = at(0.50);
+    summary.p90_ns = at(0.90);
+    summary.p99_ns = at(0.99);
+    summary.p999_ns = at(0.999);
+    summary.max_ns = samples.back();
+    return summary;
+}
+
+inline void print_latency_header(const std::string& label) {
+    std::cout << std::left << std::setw(28) << label << std::right
+              << std::setw(10) << "mean" << std::setw(10) << "min"
+              << std::setw(10) << "p50" << std::setw(10) << "p90"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(12) << "max (ns)" << std::endl;
+}
+
+inline void print_latency_row(const std::string& name, const latency_summary& s) {
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(10) << s.mean_ns << std::setw(10) << s.min_ns
+              << std::setw(10) << s.p50_ns << std::setw(10) << s.p90_ns
+              << std::setw(10) << s.p99_ns << std::setw(10) << s.p999_ns
+              << std::setw(12) << s.max_ns << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+enum class wait_mode {
+    busy_spin,
+    yield,
+};
+
+// Bounces a token through a request and a reply queue. The initiator times
+// each round trip; the responder echoes every token straight back. cpu < 0
+// leaves that side unpinned.
+template <typename Queue>
+latency_summary run_ping_pong(int rounds, int warmup_rounds, wait_mode mode,
+                              int initiator_cpu, int responder_cpu) {
+    Queue requests;
+    Queue replies;
+    std::vector<std::uint64_t> samples;
+    samples.reserve(rounds);
+
+    auto wait_pop = [mode](Queue& queue, int& out) {
+        while (!bench_pop(queue, out)) {
+            if (mode == wait_mode::busy_spin) {
+                cpu_relax();
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    int const total_rounds = warmup_rounds + rounds;
+    std::thread responder([&, total_rounds]() {
+        if (responder_cpu >= 0) {
+            pin_current_thread(responder_cpu);
+        }
+        int token;
+        for (int i = 0; i < total_rounds; ++i) {
+            wait_pop(requests, token);
+            replies.push(token);
+        }
+    });
+
+    // The initiator gets its own thread too, so pinning it never narrows the
+    // caller's affinity mask.
+    std::thread initiator([&, total_rounds]() {
+        if (initiator_cpu >= 0) {
+            pin_current_thread(initiator_cpu);
+        }
+        int token;
+        for (int i = 0; i < total_rounds; ++i) {
+            auto const sent = std::chrono::steady_clock::now();
+            requests.push(i);
+            wait_pop(replies, token);
+            auto const received = std::chrono::steady_clock::now();
+            if (i >= warmup_rounds) {
+                samples.push_back(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(received - sent).count()));
+            }
+        }
+    });
+    initiator.join();
+    responder.join();
+    return summarize_latencies(samples);
+}
+
+// Item carried by paced workloads: who sent it and when it counts as sent.
+struct timed_item {
+    std::uint64_t stamp_ns = 0;
+    int producer = 0;
+    int seq = 0;
+};
+
+struct paced_result {
+    std::string name;
+    std::size_t items = 0;
+    double achieved_rate = 0;
+    long long empty_pops = 0;
+    long long empty_transitions = 0;
+    bool verified = false;
+    latency_summary latency;
+};
+
+enum class latency_origin {
+    // Latency measured from the moment push() was called.
+    actual_send,
+    // Latency measured from the schedule's intended send time, so time a
+    // producer spent falling behind is charged too.
+    intended_send,
+};
+
+// Producers push according to their arrival schedules; consumers pop as fast as
+// they can and record enqueue-to-dequeue latency. empty_transitions counts pops
+// that found the queue empty right after a successful one, i.e. how often the
+// consumers drained the queue and hit the dummy-node path.
+template <typename Queue>
+paced_result run_paced(const std::string& name, const std::vector<arrival_schedule>& schedules,
+                       int num_consumers, latency_origin origin) {
+    Queue queue;
+    std::atomic<bool> start{false};
+    std::atomic<bool> producers_done{false};
+    std::size_t total = 0;
+    for (const auto& schedule : schedules) {
+        total += schedule.size();
+    }
+
+    struct alignas(64) consumer_state {
+        std::vector<std::uint64_t> latencies;
+        long long empty_pops = 0;
+        long long empty_transitions = 0;
+    };
+    std::vector<consumer_state> states(num_consumers);
+    for (auto& state : states) {
+        state.latencies.reserve(total);
+    }
+    // Schedules can differ in length, so producer p's item i is logged as
+    // p * longest + i and checked like the throughput runs.
+    std::size_t longest = 0;
+    for (const auto& schedule : schedules) {
+        longest = std::max(longest, schedule.size());
+    }
+    std::vector<pop_log> logs(num_consumers);
+    for (auto& log : logs) {
+        log.reserve(total);
+    }
+
+    std::chrono::steady_clock::time_point run_start;
+    auto ns_since_start = [&run_start]() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - run_start).count());
+    };
+
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < schedules.size(); ++p) {
+        producers.emplace_back([&, p]() {
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            const arrival_schedule& schedule = schedules[p];
+            for (std::size_t i = 0; i < schedule.size(); ++i) {
+                wait_until(run_start + std::chrono::nanoseconds(schedule[i]));
+                timed_item item;
+                item.stamp_ns = origin == latency_origin::intended_send ? schedule[i] : ns_since_start();
+                item.producer = static_cast<int>(p);
+                item.seq = static_cast<int>(i);
+                queue.push(item);
+            }
+        });
+    }
+    std::vector<std::thread> consumers;
+    for (int c = 0; c < num_consumers; ++c) {
+        consumers.emplace_back([&, c]() {
+            while (!start.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            consumer_state& state = states[c];
+            pop_log& log = logs[c];
+            timed_item item;
+            bool last_was_item = false;
+            for (;;) {
+                bool const done = producers_done.load(std::memory_order_acquire);
+                if (bench_pop(queue, item)) {
+                    state.latencies.push_back(ns_since_start() - item.stamp_ns);
+                    log.record(item.producer * static_cast<int>(longest) + item.seq);
+                    last_was_item = true;
+                } else if (done) {
+                    break;
+                } else {
+                    ++state.empty_pops;
+                    if (last_was_item) {
+                        ++state.empty_transitions;
+                        last_was_item = false;
+                    }
+                    cpu_relax();
+                }
+            }
+        });
+    }
+
+    run_start = std::chrono::steady_clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    producers_done.store(true, std::memory_order_release);
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+    double const elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    paced_result result;
+    result.name = name;
+    std::vector<std::uint64_t> all;
+    all.reserve(total);
+    for (auto& state : states) {
+        all.insert(all.end(), state.latencies.begin(), state.latencies.end());
+        result.empty_pops += state.empty_pops;
+        result.empty_transitions += state.empty_transitions;
+    }
+    result.items = all.size();
+    result.verified = verify_pop_logs(logs, static_cast<int>(schedules.size()),
+                                      static_cast<int>(longest)).ok(total);
+    result.achieved_rate = all.size() / elapsed_s;
+    result.latency = summarize_latencies(all);
+    return result;
+}
+
+#endif //BENCHMARK_H
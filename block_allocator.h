@@ -0,0 +1,477 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef BLOCK_ALLOCATOR_H
+#define BLOCK_ALLOCATOR_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "sharded_counter.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+// Where block_pool gets its chunks from. A chunk source provides chunk_bytes
+// and allocate_chunk/free_chunk; chunks are never handed back while the pool
+// is alive. allocate_chunk must honour alignments up to the chunk size.
+// release_pages gives a chunk's physical pages back to the OS while keeping
+// the range mapped, so it reads as zeros until it is written again.
+
+inline bool release_chunk_pages(void* chunk, std::size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+    return madvise(chunk, bytes, MADV_DONTNEED) == 0;
+#else
+    (void)chunk;
+    (void)bytes;
+    return false;
+#endif
+}
+
+// Ordinary aligned heap memory.
+struct heap_chunk_source {
+    static constexpr std::size_t chunk_bytes = 64 * 1024;
+
+    static void* allocate_chunk(std::size_t bytes, std::size_t alignment) {
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    static void free_chunk(void* chunk, std::size_t, std::size_t alignment) {
+        ::operator delete(chunk, std::align_val_t(alignment));
+    }
+
+    static bool release_pages(void* chunk, std::size_t bytes) { return release_chunk_pages(chunk, bytes); }
+};
+
+// 2 MiB chunks aligned to 2 MiB and advised as transparent huge pages, so a
+// whole chunk of nodes is covered by a single TLB entry. When the kernel
+// refuses MADV_HUGEPAGE the chunk simply stays on normal pages; platforms
+// without mmap use the heap.
+struct huge_page_chunk_source {
+    static constexpr std::size_t chunk_bytes = 2 * 1024 * 1024;
+
+    // Chunks that were (or were not) accepted for huge pages.
+    static std::atomic<std::size_t>& huge_chunks() {
+        static std::atomic<std::size_t> count{0};
+        return count;
+    }
+
+    static std::atomic<std::size_t>& fallback_chunks() {
+        static std::atomic<std::size_t> count{0};
+        return count;
+    }
+
+    static void* allocate_chunk(std::size_t bytes, std::size_t alignment) {
+#if defined(__unix__) || defined(__APPLE__)
+        // Over-map and trim, to get a range aligned to at least 2 MiB.
+        std::size_t const align = std::max(alignment, chunk_bytes);
+        std::size_t const span = bytes + align;
+        void* const raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        auto const base = reinterpret_cast<std::uintptr_t>(raw);
+        std::uintptr_t const aligned = (base + align - 1) & ~(align - 1);
+        if (aligned > base) {
+            munmap(raw, aligned - base);
+        }
+        std::uintptr_t const end = base + span;
+        if (end > aligned + bytes) {
+            munmap(reinterpret_cast<void*>(aligned + bytes), end - (aligned + bytes));
+        }
+        void* const chunk = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+        if (madvise(chunk, bytes, MADV_HUGEPAGE) == 0) {
+            huge_chunks().fetch_add(1, std::memory_order_relaxed);
+            return chunk;
+        }
+#endif
+        fallback_chunks().fetch_add(1, std::memory_order_relaxed);
+        return chunk;
+#else
+        fallback_chunks().fetch_add(1, std::memory_order_relaxed);
+        return heap_chunk_source::allocate_chunk(bytes, alignment);
+#endif
+    }
+
+    static void free_chunk(void* chunk, std::size_t bytes, std::size_t alignment) {
+#if defined(__unix__) || defined(__APPLE__)
+        (void)alignment;
+        munmap(chunk, bytes);
+#else
+        heap_chunk_source::free_chunk(chunk, bytes, alignment);
+#endif
+    }
+
+    static bool release_pages(void* chunk, std::size_t bytes) { return release_chunk_pages(chunk, bytes); }
+};
+
+// Occupancy of a block_pool (or a set of them).
+struct block_pool_stats {
+    std::size_t block_size = 0;
+    std::size_t total_blocks = 0;  // carved from chunks so far
+    std::size_t free_blocks = 0;   // on the free list
+    std::size_t retained_bytes = 0;  // chunks backed by memory
+    std::size_t released_bytes = 0;  // chunks whose pages were handed back by trim()
+};
+
+// Lock-free pool of equally sized blocks, intended for queue nodes. Blocks are
+// carved out of chunks from ChunkSource and recycled through a Treiber stack,
+// so nodes keep getting reused within the same chunks; chunks are
+// only returned when the pool itself is destroyed, which is what makes reading
+// a stale free-list link safe. The head packs a 16-bit ABA tag into the unused
+// top bits of the pointer, so it stays a single 64-bit CAS.
+//
+// Chunks are aligned to their size and start with a header naming the pool
+// that carved them, so owner_of() can route any block back to its pool.
+//
+// trim() returns the pages of completely free chunks to the OS. The chunks
+// stay mapped (stale free-list reads see zeros and fail their CAS) and are
+// carved again before any new chunk is allocated.
+template <std::size_t BlockSize, std::size_t Alignment, typename ChunkSource = heap_chunk_source>
+class block_pool {
+private:
+    static_assert(sizeof(void*) == 8, "block_pool packs a tag into 64-bit pointers");
+
+    struct free_block {
+        std::atomic<free_block*> next;
+    };
+
+    struct chunk_header {
+        block_pool* owner;
+    };
+
+    static constexpr std::size_t alignment = std::max(Alignment, alignof(free_block));
+    static constexpr std::size_t block_size =
+        (std::max(BlockSize, sizeof(free_block)) + alignment - 1) / alignment * alignment;
+    static constexpr std::size_t chunk_bytes =
+        std::bit_ceil(std::max<std::size_t>(ChunkSource::chunk_bytes, block_size * 64));
+    static constexpr std::size_t header_blocks = (sizeof(chunk_header) + block_size - 1) / block_size;
+    static constexpr std::size_t blocks_per_chunk = chunk_bytes / block_size - header_blocks;
+
+    static std::uintptr_t chunk_of(const void* p) {
+        return reinterpret_cast<std::uintptr_t>(p) & ~(chunk_bytes - 1);
+    }
+    static constexpr int tag_shift = 48;
+    static constexpr std::uint64_t pointer_mask = (std::uint64_t(1) << tag_shift) - 1;
+
+    std::atomic<std::uint64_t> free_head{0};
+    std::mutex chunk_mutex;
+    std::vector<void*> chunks;
+    std::vector<void*> released;
+    sharded_counter in_use;
+
+    static free_block* pointer_of(std::uint64_t word) {
+        return reinterpret_cast<free_block*>(word & pointer_mask);
+    }
+
+    static std::uint64_t pack(free_block* p, std::uint64_t old_word) {
+        std::uint64_t const tag = (old_word >> tag_shift) + 1;
+        return (tag << tag_shift) | reinterpret_cast<std::uint64_t>(p);
+    }
+
+    // Pushes the already linked chain first..last in one CAS.
+    void push_chain(free_block* first, free_block* last) {
+        std::uint64_t old_head = free_head.load(std::memory_order_relaxed);
+        do {
+            last->next.store(pointer_of(old_head), std::memory_order_relaxed);
+        } while (!free_head.compare_exchange_weak(old_head, pack(first, old_head),
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+    }
+
+    free_block* pop_free() {
+        std::uint64_t old_head = free_head.load(std::memory_order_acquire);
+        for (;;) {
+            free_block* const top = pointer_of(old_head);
+            if (!top) {
+                return nullptr;
+            }
+            // top may already have been taken by another thread; its memory is
+            // still ours, and the tag makes the CAS fail if it was.
+            free_block* const next = top->next.load(std::memory_order_relaxed);
+            if (free_head.compare_exchange_weak(old_head, pack(next, old_head),
+                                                std::memory_order_acquire,
+                                                std::memory_order_acquire)) {
+                return top;
+            }
+        }
+    }
+
+    void* refill() {
+        std::lock_guard<std::mutex> lock(chunk_mutex);
+        // Somebody else may have refilled while we waited for the lock.
+        if (free_block* const recycled = pop_free()) {
+            return recycled;
+        }
+        unsigned char* chunk;
+        if (!released.empty()) {
+            chunk = static_cast<unsigned char*>(released.back());
+            released.pop_back();
+        } else {
+            chunk = static_cast<unsigned char*>(ChunkSource::allocate_chunk(chunk_bytes, chunk_bytes));
+            chunks.push_back(chunk);
+        }
+        new (chunk) chunk_header{this};
+        std::size_t const count = chunk_bytes / block_size;
+        free_block* first = nullptr;
+        free_block* last = nullptr;
+        // The first block after the header goes to the caller, the rest onto
+        // the free list.
+        for (std::size_t i = count - 1; i > header_blocks; --i) {
+            auto* const b = new (chunk + i * block_size) free_block;
+            b->next.store(first, std::memory_order_relaxed);
+            first = b;
+            if (!last) {
+                last = b;
+            }
+        }
+        if (first) {
+            push_chain(first, last);
+        }
+        return chunk + header_blocks * block_size;
+    }
+
+public:
+    block_pool() = default;
+    block_pool(const block_pool&) = delete;
+    block_pool& operator=(const block_pool&) = delete;
+
+    ~block_pool() {
+        for (void* chunk : chunks) {
+            ChunkSource::free_chunk(chunk, chunk_bytes, chunk_bytes);
+        }
+    }
+
+    void* allocate() {
+        in_use.add(1);
+        if (free_block* const b = pop_free()) {
+            return b;
+        }
+        return refill();
+    }
+
+    void deallocate(void* p) {
+        auto* const b = new (p) free_block;
+        push_chain(b, b);
+        in_use.add(-1);
+    }
+
+    // Returns n blocks with a single CAS on the free list.
+    void deallocate_batch(void* const* blocks, std::size_t n) {
+        if (n == 0) {
+            return;
+        }
+        free_block* const first = new (blocks[0]) free_block;
+        free_block* last = first;
+        for (std::size_t i = 1; i < n; ++i) {
+            free_block* const b = new (blocks[i]) free_block;
+            last->next.store(b, std::memory_order_relaxed);
+            last = b;
+        }
+        push_chain(first, last);
+        in_use.add(-static_cast<std::int64_t>(n));
+    }
+
+    // Approximate while other threads allocate or free.
+    block_pool_stats stats() {
+        std::lock_guard<std::mutex> lock(chunk_mutex);
+        block_pool_stats s;
+        s.block_size = block_size;
+        s.total_blocks = (chunks.size() - released.size()) * blocks_per_chunk;
+        s.retained_bytes = (chunks.size() - released.size()) * chunk_bytes;
+        s.released_bytes = released.size() * chunk_bytes;
+        auto const used = static_cast<std::size_t>(std::max<std::int64_t>(in_use.load(), 0));
+        s.free_blocks = s.total_blocks - std::min(used, s.total_blocks);
+        return s;
+    }
+
+    // Releases completely free chunks until at most max_retained bytes of free
+    // blocks stay backed by memory; returns the bytes released. The free list
+    // is detached while it is sorted by chunk, under chunk_mutex, so an
+    // allocation that finds it empty waits in refill() for it to come back
+    // rather than carving a new chunk. A chunk whose pages could not be
+    // released stays on the free list.
+    std::size_t trim(std::size_t max_retained) {
+        if (stats().free_blocks * block_size <= max_retained) {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(chunk_mutex);
+        std::uint64_t old_head = free_head.load(std::memory_order_acquire);
+        while (pointer_of(old_head) &&
+               !free_head.compare_exchange_weak(old_head, pack(nullptr, old_head),
+                                                std::memory_order_acquire,
+                                                std::memory_order_acquire)) {
+        }
+        free_block* const list = pointer_of(old_head);
+        if (!list) {
+            return 0;
+        }
+
+        std::unordered_map<std::uintptr_t, std::size_t> free_per_chunk;
+        std::size_t resident_free = 0;
+        for (free_block* b = list; b; b = b->next.load(std::memory_order_relaxed)) {
+            ++free_per_chunk[chunk_of(b)];
+            resident_free += block_size;
+        }
+        std::unordered_set<std::uintptr_t> victims;
+        for (const auto& [chunk, count] : free_per_chunk) {
+            if (resident_free <= max_retained) {
+                break;
+            }
+            if (count == blocks_per_chunk) {
+                victims.insert(chunk);
+                resident_free -= blocks_per_chunk * block_size;
+            }
+        }
+
+        std::size_t released_bytes = 0;
+        released.reserve(released.size() + victims.size());
+        for (auto it = victims.begin(); it != victims.end();) {
+            void* const p = reinterpret_cast<void*>(*it);
+            if (ChunkSource::release_pages(p, chunk_bytes)) {
+                released.push_back(p);
+                released_bytes += chunk_bytes;
+                ++it;
+            } else {
+                it = victims.erase(it);
+            }
+        }
+
+        free_block* first = nullptr;
+        free_block* last = nullptr;
+        for (free_block* b = list; b;) {
+            free_block* const next = b->next.load(std::memory_order_relaxed);
+            if (!victims.contains(chunk_of(b))) {
+                b->next.store(first, std::memory_order_relaxed);
+                first = b;
+                if (!last) {
+                    last = b;
+                }
+            }
+            b = next;
+        }
+        if (first) {
+            push_chain(first, last);
+        }
+        return released_bytes;
+    }
+
+    // The pool whose chunk p was allocated from.
+    static block_pool* owner_of(const void* p) {
+        return reinterpret_cast<const chunk_header*>(chunk_of(p))->owner;
+    }
+
+    // Process-wide pool for this block shape. Deliberately never destroyed, so
+    // queues with static storage duration can still free into it at exit.
+    static block_pool& instance() {
+        static block_pool* const pool = new block_pool;
+        return *pool;
+    }
+};
+
+// std::allocator_traits-compatible allocator that serves single-object
+// allocations from the block_pool matching the type's size and alignment, and
+// anything larger from operator new. Stateless: all instances compare equal.
+template <typename T, typename ChunkSource = heap_chunk_source>
+class fixed_block_allocator {
+private:
+    using pool = block_pool<sizeof(T), alignof(T), ChunkSource>;
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = fixed_block_allocator<U, ChunkSource>;
+    };
+
+    fixed_block_allocator() noexcept = default;
+
+    template <typename U>
+    fixed_block_allocator(const fixed_block_allocator<U, ChunkSource>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n == 1) {
+            return static_cast<T*>(pool::instance().allocate());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if (n == 1) {
+            pool::instance().deallocate(p);
+            return;
+        }
+        ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    // Occupancy of the pool serving single T allocations.
+    static block_pool_stats pool_stats() { return pool::instance().stats(); }
+
+    static std::size_t trim(std::size_t max_retained) { return pool::instance().trim(max_retained); }
+
+    template <typename U>
+    bool operator==(const fixed_block_allocator<U, ChunkSource>&) const noexcept { return true; }
+};
+
+// Node arena backed by 2 MiB transparent huge pages.
+template <typename T>
+using huge_page_allocator = fixed_block_allocator<T, huge_page_chunk_source>;
+
+// Runs a trim function on a fixed period from its own thread, e.g.
+// [&q] { return q.trim(1 << 20); }, until destroyed.
+class background_trimmer {
+private:
+    std::function<std::size_t()> trim;
+    std::chrono::milliseconds const interval;
+    std::mutex m;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::atomic<std::size_t> released{0};
+    std::atomic<std::size_t> passes{0};
+    std::thread worker;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m);
+        while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            released.fetch_add(trim(), std::memory_order_relaxed);
+            passes.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+    }
+
+public:
+    background_trimmer(std::function<std::size_t()> trim_fn, std::chrono::milliseconds period)
+        : trim(std::move(trim_fn)), interval(period), worker([this] { run(); }) {}
+
+    background_trimmer(const background_trimmer&) = delete;
+    background_trimmer& operator=(const background_trimmer&) = delete;
+
+    ~background_trimmer() {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stopping = true;
+        }
+        cv.notify_one();
+        worker.join();
+    }
+
+    // Total bytes released so far, and how many trims ran.
+    std::size_t released_bytes() const { return released.load(std::memory_order_relaxed); }
+    std::size_t trim_passes() const { return passes.load(std::memory_order_relaxed); }
+};
+
+#endif //BLOCK_ALLOCATOR_H
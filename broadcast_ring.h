@@ -0,0 +1,194 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef BROADCAST_RING_H
+#define BROADCAST_RING_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include "spin_wait.h"
+
+// How a broadcast_ring thread waits for a slot to be published or freed.
+enum class ring_wait {
+    busy_spin,  // lowest latency, burns a core per waiter
+    backoff,    // spin briefly, then yield
+    blocking,   // sleep in std::atomic::wait until notified
+};
+
+// Disruptor-style broadcast ring: each item is published once into a fixed
+// ring of slots and every subscriber reads it there, keeping its own cursor,
+// instead of the producer copying it into one queue per subscriber.
+//
+// Producers claim sequence numbers with a fetch_add and mark a slot published
+// by storing the sequence into it. A producer may not reuse a slot until every
+// subscriber's cursor has moved past it (gating), so a slow subscriber holds
+// the producers back rather than losing items. The slowest cursor is cached so
+// producers only rescan the subscribers when they catch up with it.
+//
+// Subscribers are registered with subscribe() before anything is published;
+// each subscription must be read by one thread at a time.
+template <typename T>
+class broadcast_ring {
+private:
+    static constexpr std::uint64_t unpublished = std::numeric_limits<std::uint64_t>::max();
+
+    struct slot {
+        std::atomic<std::uint64_t> sequence{unpublished};
+        T value;
+    };
+
+    struct alignas(64) cursor {
+        // Next sequence this subscriber will read.
+        std::atomic<std::uint64_t> next{0};
+    };
+
+    std::unique_ptr<slot[]> slots;
+    std::size_t const mask;
+    std::unique_ptr<cursor[]> cursors;
+    std::size_t const max_subscribers;
+    std::size_t subscriber_count = 0;
+    ring_wait const wait;
+    alignas(64) std::atomic<std::uint64_t> claim{0};
+    // Lower bound on every subscriber's cursor.
+    alignas(64) std::atomic<std::uint64_t> gate{0};
+
+    template <typename Ready, typename Atomic>
+    void wait_until(Ready ready, Atomic& watched) const {
+        spin_backoff backoff;
+        while (!ready()) {
+            switch (wait) {
+            case ring_wait::busy_spin:
+                cpu_relax();
+                break;
+            case ring_wait::backoff:
+                backoff.pause();
+                break;
+            case ring_wait::blocking: {
+                auto const seen = watched.load();
+                if (!ready()) {
+                    watched.wait(seen);
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    std::uint64_t slowest_cursor(std::size_t& slowest) const {
+        std::uint64_t lowest = std::numeric_limits<std::uint64_t>::max();
+        for (std::size_t i = 0; i < subscriber_count; ++i) {
+            std::uint64_t const next = cursors[i].next.load(std::memory_order_acquire);
+            if (next < lowest) {
+                lowest = next;
+                slowest = i;
+            }
+        }
+        return lowest;
+    }
+
+    // Waits until sequence s no longer overwrites an unread slot.
+    void wait_for_gate(std::uint64_t s) {
+        std::uint64_t const needed = s + 1 - capacity();
+        if (s < capacity() || gate.load(std::memory_order_acquire) >= needed) {
+            return;
+        }
+        for (;;) {
+            std::size_t slowest = 0;
+            std::uint64_t const lowest = slowest_cursor(slowest);
+            std::uint64_t cached = gate.load(std::memory_order_relaxed);
+            while (cached < lowest && !gate.compare_exchange_weak(cached, lowest, std::memory_order_release,
+                                                                  std::memory_order_relaxed)) {
+            }
+            if (lowest >= needed) {
+                return;
+            }
+            std::atomic<std::uint64_t>& watched = cursors[slowest].next;
+            wait_until([&] { return watched.load(std::memory_order_acquire) >= needed; }, watched);
+        }
+    }
+
+public:
+    using subscription = std::size_t;
+
+    // capacity is rounded up to a power of two.
+    explicit broadcast_ring(std::size_t capacity = 1 << 16, std::size_t max_subscribers = 64,
+                            ring_wait wait_strategy = ring_wait::backoff)
+        : slots(new slot[std::bit_ceil(std::max<std::size_t>(capacity, 2))]),
+          mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+          cursors(new cursor[max_subscribers]),
+          max_subscribers(max_subscribers),
+          wait(wait_strategy) {}
+
+    broadcast_ring(const broadcast_ring&) = delete;
+    broadcast_ring& operator=(const broadcast_ring&) = delete;
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // Not thread-safe; call before the first publish.
+    subscription subscribe() {
+        assert(claim.load() == 0 && "subscribe() after publishing has started");
+        assert(subscriber_count < max_subscribers && "too many subscribers");
+        return subscriber_count++;
+    }
+
+    // Publishes one item to every subscriber, waiting while the slowest one is
+    // a full ring behind. Without subscribers the item is dropped.
+    template <typename U>
+    void publish(U&& value) {
+        if (subscriber_count == 0) {
+            return;
+        }
+        std::uint64_t const s = claim.fetch_add(1, std::memory_order_relaxed);
+        wait_for_gate(s);
+        slot& sl = slots[s & mask];
+        sl.value = std::forward<U>(value);
+        sl.sequence.store(s, std::memory_order_release);
+        if (wait == ring_wait::blocking) {
+            sl.sequence.notify_all();
+        }
+    }
+
+    // Calls f(const T&) on up to max_batch items published after the
+    // subscriber's cursor, in sequence order, then moves the cursor once for
+    // the whole batch. Returns how many were read; 0 if none were ready.
+    template <typename F>
+    std::size_t consume(subscription sub, F&& f, std::size_t max_batch = 256) {
+        cursor& c = cursors[sub];
+        std::uint64_t const first = c.next.load(std::memory_order_relaxed);
+        std::uint64_t s = first;
+        while (s - first < max_batch && slots[s & mask].sequence.load(std::memory_order_acquire) == s) {
+            f(static_cast<const T&>(slots[s & mask].value));
+            ++s;
+        }
+        if (s != first) {
+            c.next.store(s, std::memory_order_release);
+            if (wait == ring_wait::blocking) {
+                c.next.notify_all();
+            }
+        }
+        return static_cast<std::size_t>(s - first);
+    }
+
+    // As consume(), but waits (per the ring's wait strategy) for at least one
+    // item.
+    template <typename F>
+    std::size_t wait_consume(subscription sub, F&& f, std::size_t max_batch = 256) {
+        std::uint64_t const s = cursors[sub].next.load(std::memory_order_relaxed);
+        std::atomic<std::uint64_t>& watched = slots[s & mask].sequence;
+        wait_until([&] { return watched.load(std::memory_order_acquire) == s; }, watched);
+        return consume(sub, std::forward<F>(f), max_batch);
+    }
+
+    bool try_read(subscription sub, T& out) {
+        return consume(sub, [&out](const T& value) { out = value; }, 1) == 1;
+    }
+};
+
+#endif //BROADCAST_RING_H
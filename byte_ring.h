@@ -0,0 +1,190 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include "spin_wait.h"
+
+// MPMC queue of variable-length byte messages in one contiguous ring. A
+// producer reserve()s a span, writes the message in place and commit()s it; a
+// consumer try_read()s a span, uses it in place and release()s it. Messages
+// are never copied or heap-allocated, and each one is contiguous: one that
+// would straddle the end of the ring is placed at its start, behind a skip
+// record covering the leftover bytes.
+//
+// The ring is cut into 16-byte cells and a record's payload, padded to whole
+// cells, starts at any cell. Each cell has a header in a separate array, used
+// when a record starts there, so headers never share memory with payload
+// bytes (the header array is as large as the ring itself). Three positions
+// only ever grow: write (next byte to reserve), read (next record to hand to a
+// consumer) and free (everything before it has been released and may be
+// reused). A header's seq holds its record's position and state; headers are
+// only written at record starts, so one left over from an earlier lap holds an
+// older position and is never mistaken for a new one.
+//
+// Records are handed out in reservation order, so a reserved but uncommitted
+// record holds back the consumers behind it; releases may come in any order,
+// but space is only reclaimed up to the oldest unreleased record.
+class byte_ring {
+private:
+    static constexpr std::uint64_t committed = 1;
+    static constexpr std::uint64_t released = 2;
+    static constexpr std::uint32_t skip_flag = std::uint32_t(1) << 31;
+
+    struct header {
+        std::atomic<std::uint64_t> seq{0};  // position << 2 | state
+        std::atomic<std::uint32_t> size{0};  // payload bytes, skip_flag for padding
+    };
+
+    static constexpr std::size_t cell_size = 16;
+
+    std::size_t const mask;
+    std::unique_ptr<header[]> headers;  // one per cell
+    std::unique_ptr<std::byte[]> data;
+    alignas(64) std::atomic<std::uint64_t> write_pos{0};
+    alignas(64) std::atomic<std::uint64_t> read_pos{0};
+    alignas(64) std::atomic<std::uint64_t> free_pos{0};
+
+    // Cells a record takes; an empty message still takes one.
+    static std::size_t record_bytes(std::size_t payload) {
+        return std::max(cell_size, (payload + cell_size - 1) & ~(cell_size - 1));
+    }
+
+    header& header_at(std::uint64_t pos) { return headers[(pos & mask) / cell_size]; }
+
+    std::byte* payload_at(std::uint64_t pos) { return data.get() + (pos & mask); }
+
+    std::size_t record_bytes_at(header& h) {
+        std::uint32_t const size = h.size.load(std::memory_order_relaxed);
+        return (size & skip_flag) ? (size & ~skip_flag) : record_bytes(size);
+    }
+
+    void mark_released(std::uint64_t pos) {
+        header_at(pos).seq.store(pos << 2 | released);
+        // Move free past every released record at the front. Whoever releases
+        // the oldest record carries free over the ones released before it.
+        std::uint64_t f = free_pos.load();
+        while (f < read_pos.load()) {
+            header& h = header_at(f);
+            if (h.seq.load() != (f << 2 | released)) {
+                return;
+            }
+            std::size_t const bytes = record_bytes_at(h);
+            if (free_pos.compare_exchange_strong(f, f + bytes)) {
+                f += bytes;
+            }
+        }
+    }
+
+public:
+    struct reservation {
+        std::byte* data = nullptr;
+        std::size_t size = 0;
+        std::uint64_t pos = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    struct message {
+        const std::byte* data = nullptr;
+        std::size_t size = 0;
+        std::uint64_t pos = 0;
+    };
+
+    // capacity is rounded up to a power of two, at least 64 bytes.
+    explicit byte_ring(std::size_t capacity = 1 << 20)
+        : mask(std::bit_ceil(std::max<std::size_t>(capacity, 64)) - 1),
+          headers(new header[(mask + 1) / cell_size]),
+          data(new std::byte[mask + 1]) {}
+
+    byte_ring(const byte_ring&) = delete;
+    byte_ring& operator=(const byte_ring&) = delete;
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // Largest payload reserve() accepts; a bigger one could need more than
+    // the whole ring once padded to the start.
+    std::size_t max_message_size() const { return capacity() / 2; }
+
+    // Claims n contiguous bytes; false if the ring is too full right now.
+    bool try_reserve(std::size_t n, reservation& out) {
+        if (n > max_message_size()) {
+            throw std::length_error("byte_ring message larger than max_message_size()");
+        }
+        std::size_t const bytes = record_bytes(n);
+        std::uint64_t w = write_pos.load(std::memory_order_relaxed);
+        std::size_t padding;
+        do {
+            std::size_t const offset = w & mask;
+            padding = offset + bytes > capacity() ? capacity() - offset : 0;
+            if (w + padding + bytes - free_pos.load(std::memory_order_acquire) > capacity()) {
+                return false;
+            }
+        } while (!write_pos.compare_exchange_weak(w, w + padding + bytes, std::memory_order_relaxed));
+
+        if (padding) {
+            header& skip = header_at(w);
+            skip.size.store(static_cast<std::uint32_t>(padding) | skip_flag, std::memory_order_relaxed);
+            skip.seq.store(w << 2 | committed, std::memory_order_release);
+            w += padding;
+        }
+        header_at(w).size.store(static_cast<std::uint32_t>(n), std::memory_order_relaxed);
+        out = {payload_at(w), n, w};
+        return true;
+    }
+
+    // As try_reserve(), waiting for consumers to free space.
+    reservation reserve(std::size_t n) {
+        reservation r;
+        spin_backoff backoff;
+        while (!try_reserve(n, r)) {
+            backoff.pause();
+        }
+        return r;
+    }
+
+    // Publishes a reservation's bytes to consumers.
+    void commit(const reservation& r) {
+        header_at(r.pos).seq.store(r.pos << 2 | committed, std::memory_order_release);
+    }
+
+    // Takes the oldest committed message; false if there is none, or if the
+    // oldest reservation is not committed yet. The span stays valid until
+    // release().
+    bool try_read(message& out) {
+        std::uint64_t r = read_pos.load();
+        for (;;) {
+            // A slow reader may look at a header from a later lap; the
+            // read_pos CAS below then fails, so what it saw is never used.
+            header& h = header_at(r);
+            if (h.seq.load(std::memory_order_acquire) != (r << 2 | committed)) {
+                return false;
+            }
+            std::uint32_t const size = h.size.load(std::memory_order_relaxed);
+            std::size_t const bytes = record_bytes_at(h);
+            if (!read_pos.compare_exchange_weak(r, r + bytes)) {
+                continue;
+            }
+            if (size & skip_flag) {
+                mark_released(r);
+                r += bytes;
+                continue;
+            }
+            out = {payload_at(r), size, r};
+            return true;
+        }
+    }
+
+    // Hands a read message's space back to producers.
+    void release(const message& m) { mark_released(m.pos); }
+};
+
+#endif //BYTE_RING_H
@@ -0,0 +1,48 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef CYCLE_CLOCK_H
+#define CYCLE_CLOCK_H
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheapest monotonic timestamp the CPU offers: the TSC on x86, the virtual
+// counter on AArch64, steady_clock nanoseconds elsewhere. Only differences
+// between two readings on the same machine are meaningful.
+inline std::uint64_t read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    std::uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Counter ticks per nanosecond, measured once against steady_clock.
+inline double cycles_per_ns() {
+    static double const ratio = [] {
+        auto const t0 = std::chrono::steady_clock::now();
+        std::uint64_t const c0 = read_cycle_counter();
+        while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(10)) {
+        }
+        auto const t1 = std::chrono::steady_clock::now();
+        std::uint64_t const c1 = read_cycle_counter();
+        double const ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        return static_cast<double>(c1 - c0) / ns;
+    }();
+    return ratio;
+}
+
+inline double cycles_to_ns(std::uint64_t cycles) {
+    return static_cast<double>(cycles) / cycles_per_ns();
+}
+
+#endif //CYCLE_CLOCK_H
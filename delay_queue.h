@@ -0,0 +1,255 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef DELAY_QUEUE_H
+#define DELAY_QUEUE_H
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include "queue.h"
+
+// Concurrent delay queue: items become visible to pop_due() once their
+// deadline has passed, never before.
+//
+// Deadlines are rounded up to ticks and kept in a hierarchical timing wheel,
+// levels of 64 slots each covering 64 times the span of the level below. A slot
+// is a lock-free push-only list: push_at() is one CAS on the slot its deadline
+// maps to, whatever the number of pending timers. pop_due() advances the wheel
+// to `now` (one thread at a time; the others skip ahead), which detaches the
+// slots it passes with an exchange, moves items that are due into a
+// lock_free_queue and re-files the rest a level down. Each level keeps a
+// bitmask of slots that may hold timers, so the wheel jumps straight to the
+// next tick with work instead of stepping through idle ones.
+//
+// A pusher that picked its slot from a wheel position that has since moved on
+// may have landed in a slot already passed; it notices the move and re-files
+// that whole slot, so no timer waits for the wheel to come round again.
+template <typename T, typename Clock = std::chrono::steady_clock, typename Allocator = std::allocator<T>>
+class delay_queue {
+public:
+    using time_point = typename Clock::time_point;
+    using duration = typename Clock::duration;
+
+private:
+    static constexpr int slot_bits = 6;
+    static constexpr std::size_t slots_per_level = std::size_t(1) << slot_bits;
+    static constexpr int levels = 4;  // 2^24 ticks, about 4.6 hours at 1 ms
+
+    struct timer_node {
+        std::uint64_t due;  // tick
+        T value;
+        timer_node* next = nullptr;
+    };
+
+    using node_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<timer_node>;
+    using node_traits = std::allocator_traits<node_allocator_type>;
+
+    std::atomic<timer_node*> wheel[levels][slots_per_level] = {};
+    // Bit i of occupied[l] is set after a timer is linked into wheel[l][i] and
+    // cleared before the slot is drained, so a clear bit means an empty slot.
+    alignas(64) std::atomic<std::uint64_t> occupied[levels] = {};
+    // Last tick the wheel has been advanced to; only grows.
+    alignas(64) std::atomic<std::uint64_t> current{0};
+    std::atomic<bool> advancing{false};
+    lock_free_queue<T, Allocator> ready;
+    time_point const origin;
+    duration const tick;
+    [[no_unique_address]] node_allocator_type node_allocator;
+
+    std::uint64_t floor_tick(time_point t) const {
+        return t <= origin ? 0 : static_cast<std::uint64_t>((t - origin) / tick);
+    }
+
+    std::uint64_t ceil_tick(time_point t) const {
+        if (t <= origin) {
+            return 0;
+        }
+        auto const elapsed = t - origin;
+        return static_cast<std::uint64_t>((elapsed + tick - duration(1)) / tick);
+    }
+
+    // Level is the highest 6-bit group in which due and now differ; the slot is
+    // due's digit there. Deadlines beyond the top level wait in its slots and
+    // are re-filed each time the top level comes round.
+    static std::pair<int, std::size_t> slot_for(std::uint64_t due, std::uint64_t now) {
+        int level = (63 - std::countl_zero(due ^ now)) / slot_bits;
+        if (level >= levels) {
+            level = levels - 1;
+        }
+        return {level, static_cast<std::size_t>((due >> (level * slot_bits)) & (slots_per_level - 1))};
+    }
+
+    static std::uint64_t slot_bit(std::size_t index) { return std::uint64_t(1) << index; }
+
+    void drain(int level, std::size_t index) {
+        occupied[level].fetch_and(~slot_bit(index));
+        refile(wheel[level][index].exchange(nullptr));
+    }
+
+    // First tick at or after t where, per the masks m, a level-0 slot comes
+    // due or a higher level slot cascades; ~0 if there is none. Slots below
+    // the top level only stand for the current block of the level above, which
+    // later blocks reach through that level's cascade; top-level slots wrap.
+    static std::uint64_t next_busy_tick(std::uint64_t t, const std::uint64_t (&m)[levels]) {
+        std::uint64_t best = ~std::uint64_t(0);
+        for (int level = 0; level < levels; ++level) {
+            int const shift = level * slot_bits;
+            std::uint64_t const unit = std::uint64_t(1) << shift;
+            std::uint64_t const block = unit << slot_bits;
+            bool const top = level == levels - 1;
+            std::uint64_t const first = (t + unit - 1) & ~(unit - 1);
+            std::uint64_t const base = first & ~(block - 1);
+            if (!top && base != (t & ~(block - 1))) {
+                continue;
+            }
+            std::uint64_t const ahead = m[level] & (~std::uint64_t(0) << ((first >> shift) & (slots_per_level - 1)));
+            if (ahead) {
+                best = std::min(best, base + std::countr_zero(ahead) * unit);
+            } else if (top && m[level]) {
+                best = std::min(best, base + block + std::countr_zero(m[level]) * unit);
+            }
+        }
+        return best;
+    }
+
+    void make_ready(timer_node* n) {
+        ready.push(std::move(n->value));
+        node_traits::destroy(node_allocator, n);
+        node_traits::deallocate(node_allocator, n, 1);
+    }
+
+    void file(timer_node* n) {
+        std::uint64_t const now = current.load();
+        if (n->due <= now) {
+            make_ready(n);
+            return;
+        }
+        auto const [level, index] = slot_for(n->due, now);
+        std::atomic<timer_node*>& slot = wheel[level][index];
+        n->next = slot.load(std::memory_order_relaxed);
+        while (!slot.compare_exchange_weak(n->next, n)) {
+        }
+        // Plain load first: the bit is usually set already.
+        if (!(occupied[level].load() & slot_bit(index))) {
+            occupied[level].fetch_or(slot_bit(index));
+        }
+        // The wheel drains a slot only after publishing the tick that passes
+        // it, so an unchanged position means the slot is still ahead.
+        // Otherwise re-file everything in it against the new position.
+        if (current.load() != now) {
+            drain(level, index);
+        }
+    }
+
+    void refile(timer_node* list) {
+        while (list) {
+            timer_node* const next = list->next;
+            file(list);
+            list = next;
+        }
+    }
+
+    void advance(std::uint64_t target) {
+        if (current.load() >= target || advancing.exchange(true, std::memory_order_acquire)) {
+            return;
+        }
+        // Released however we leave, so a throwing push into ready cannot
+        // stop the wheel for good.
+        struct release_flag {
+            std::atomic<bool>& flag;
+            ~release_flag() { flag.store(false, std::memory_order_release); }
+        } const release{advancing};
+
+        for (std::uint64_t t = current.load() + 1; t <= target; ++t) {
+            std::uint64_t before[levels];
+            for (int level = 0; level < levels; ++level) {
+                before[level] = occupied[level].load();
+            }
+            t = std::min(next_busy_tick(t, before), target);
+            current.store(t);
+            // A pusher that read the old position and set its bit before the
+            // store above may have filed into a slot just jumped over, without
+            // seeing the position move. Re-file any slot that filled meanwhile.
+            for (int level = 0; level < levels; ++level) {
+                for (std::uint64_t added = occupied[level].load() & ~before[level]; added; added &= added - 1) {
+                    drain(level, static_cast<std::size_t>(std::countr_zero(added)));
+                }
+            }
+            // Cascade from the top so items moving down into slot t of level 0
+            // are picked up on this same tick.
+            for (int level = levels - 1; level > 0; --level) {
+                if ((t & ((std::uint64_t(1) << (level * slot_bits)) - 1)) == 0) {
+                    std::size_t const index = (t >> (level * slot_bits)) & (slots_per_level - 1);
+                    if (occupied[level].load() & slot_bit(index)) {
+                        drain(level, index);
+                    }
+                }
+            }
+            std::size_t const index = t & (slots_per_level - 1);
+            if (occupied[0].load() & slot_bit(index)) {
+                drain(0, index);
+            }
+        }
+    }
+
+public:
+    explicit delay_queue(duration tick_length = std::chrono::milliseconds(1),
+                         const Allocator& alloc = Allocator())
+        : ready(alloc), origin(Clock::now()), tick(tick_length), node_allocator(alloc) {}
+
+    delay_queue(const delay_queue&) = delete;
+    delay_queue& operator=(const delay_queue&) = delete;
+
+    ~delay_queue() {
+        for (auto& level : wheel) {
+            for (auto& slot : level) {
+                for (timer_node* n = slot.load(); n;) {
+                    timer_node* const next = n->next;
+                    node_traits::destroy(node_allocator, n);
+                    node_traits::deallocate(node_allocator, n, 1);
+                    n = next;
+                }
+            }
+        }
+    }
+
+    void push_at(time_point deadline, T value) {
+        timer_node* const n = node_traits::allocate(node_allocator, 1);
+        try {
+            node_traits::construct(node_allocator, n, timer_node{ceil_tick(deadline), std::move(value)});
+        } catch (...) {
+            node_traits::deallocate(node_allocator, n, 1);
+            throw;
+        }
+        file(n);
+    }
+
+    void push_after(duration delay, T value) { push_at(Clock::now() + delay, std::move(value)); }
+
+    // Pops an item whose deadline is at or before now; false if none is due.
+    bool pop_due(time_point now, T& out) {
+        advance(floor_tick(now));
+        return ready.try_pop(out);
+    }
+
+    std::optional<T> pop_due(time_point now) {
+        T out;
+        if (!pop_due(now, out)) {
+            return std::nullopt;
+        }
+        return out;
+    }
+
+    std::optional<T> pop_due() { return pop_due(Clock::now()); }
+
+    duration tick_length() const { return tick; }
+};
+
+#endif //DELAY_QUEUE_H
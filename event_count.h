@@ -0,0 +1,60 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef EVENT_COUNT_H
+#define EVENT_COUNT_H
+#include <atomic>
+#include <cstdint>
+
+// Lets consumers sleep until a lock-free structure changes, without a lock and
+// without producers paying for a wake-up nobody is waiting for. A consumer
+// announces itself, re-checks its condition and only then sleeps:
+//
+//     for (;;) {
+//         if (try_something()) break;
+//         auto const key = events.prepare_wait();
+//         if (try_something()) { events.cancel_wait(); break; }
+//         events.wait(key);
+//     }
+//
+// A producer makes its change visible with a seq_cst operation and then calls
+// notify(), which is a single load unless someone is parked. Because both
+// sides use seq_cst, either the consumer's re-check sees the change or the
+// producer sees the waiter and moves the epoch, so no wake-up is lost.
+class event_count {
+private:
+    std::atomic<std::uint32_t> waiters{0};
+    // Bumped by every notify() that finds a waiter; sleepers wait for it to move.
+    std::atomic<std::uint32_t> epoch{0};
+
+public:
+    using key = std::uint32_t;
+
+    event_count() = default;
+    event_count(const event_count&) = delete;
+    event_count& operator=(const event_count&) = delete;
+
+    key prepare_wait() {
+        waiters.fetch_add(1);
+        return epoch.load();
+    }
+
+    void cancel_wait() { waiters.fetch_sub(1); }
+
+    // Sleeps until a notify() after prepare_wait() returned k.
+    void wait(key k) {
+        epoch.wait(k);
+        waiters.fetch_sub(1);
+    }
+
+    // Wakes every thread parked in wait(); cheap when there are none.
+    void notify() {
+        if (waiters.load() != 0) {
+            epoch.fetch_add(1);
+            epoch.notify_all();
+        }
+    }
+};
+
+#endif //EVENT_COUNT_H
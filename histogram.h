@@ -0,0 +1,64 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Concurrent histogram with power-of-two buckets: bucket i counts values whose
+// bit width is i, i.e. values in [2^(i-1), 2^i). Recording is a single relaxed
+// increment, so it is cheap enough to sit on a queue's pop path.
+class log2_histogram {
+public:
+    static constexpr std::size_t bucket_count = 65;
+
+private:
+    std::array<std::atomic<std::uint64_t>, bucket_count> buckets{};
+
+public:
+    void record(std::uint64_t value) {
+        buckets[std::bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count(std::size_t bucket) const {
+        return buckets[bucket].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t total() const {
+        std::uint64_t sum = 0;
+        for (const auto& bucket : buckets) {
+            sum += bucket.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    // Upper bound of the bucket holding the q-th quantile, e.g. q = 0.99.
+    std::uint64_t quantile_upper_bound(double q) const {
+        std::uint64_t const n = total();
+        if (n == 0) {
+            return 0;
+        }
+        auto const target = static_cast<std::uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (std::uint64_t(1) << i) - 1);
+            }
+        }
+        return UINT64_MAX;
+    }
+
+    void reset() {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif //HISTOGRAM_H
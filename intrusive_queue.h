@@ -0,0 +1,134 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef INTRUSIVE_QUEUE_H
+#define INTRUSIVE_QUEUE_H
+#include <atomic>
+#include <cassert>
+#include <type_traits>
+#include "spin_wait.h"
+
+// Link embedded in objects that go through an intrusive_queue. Derive from it:
+//
+//     struct message : intrusive_queue_hook { ... };
+class intrusive_queue_hook {
+private:
+    template <typename T>
+    friend class intrusive_queue;
+
+    std::atomic<intrusive_queue_hook*> next{nullptr};
+    // Whether the object is linked into a queue. Only checked in debug builds,
+    // where pushing an object that is already queued asserts.
+    std::atomic<bool> queued{false};
+
+public:
+    intrusive_queue_hook() = default;
+    // Copying an object does not copy its place in a queue.
+    intrusive_queue_hook(const intrusive_queue_hook&) {}
+    intrusive_queue_hook& operator=(const intrusive_queue_hook&) { return *this; }
+};
+
+// MPMC queue of caller-owned objects linked through their embedded hook, so
+// push and pop never allocate. Dmitry Vyukov's intrusive MPSC queue: a push is
+// one exchange on the tail plus a store to the previous object's next, and
+// never waits. Consumers take turns through a spin lock held for a few loads
+// and stores, which is what makes the MPSC algorithm safe with several of
+// them.
+//
+// Lifetime rules:
+// - the queue never owns, copies, constructs or destroys the objects;
+// - an object may be in at most one intrusive_queue at a time, and must stay
+//   alive and unmoved from push() until pop() has returned it;
+// - once pop() returns an object the queue no longer touches it, so the caller
+//   may reuse, re-push or free it straight away;
+// - destroying a non-empty queue just forgets the objects still linked.
+//
+// A producer interrupted between its exchange and its store leaves the later
+// objects unreachable for that moment; pop() reports empty until it finishes.
+template <typename T>
+class intrusive_queue {
+private:
+    static_assert(std::is_base_of_v<intrusive_queue_hook, T>, "T must derive from intrusive_queue_hook");
+
+    // Producers' end: the object most recently pushed.
+    alignas(64) std::atomic<intrusive_queue_hook*> tail;
+    // Consumers' end, only touched with consumer_lock held.
+    alignas(64) std::atomic<bool> consumer_lock{false};
+    intrusive_queue_hook* head;
+    // Placeholder that keeps the list non-empty when every object is popped.
+    intrusive_queue_hook stub;
+
+    void link(intrusive_queue_hook* h) {
+        h->next.store(nullptr, std::memory_order_relaxed);
+        intrusive_queue_hook* const prev = tail.exchange(h, std::memory_order_acq_rel);
+        prev->next.store(h, std::memory_order_release);
+    }
+
+    intrusive_queue_hook* unlink() {
+        intrusive_queue_hook* first = head;
+        intrusive_queue_hook* next = first->next.load(std::memory_order_acquire);
+        if (first == &stub) {
+            if (!next) {
+                return nullptr;
+            }
+            head = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            head = next;
+            return first;
+        }
+        if (first != tail.load(std::memory_order_acquire)) {
+            return nullptr;  // a push is half-way through
+        }
+        // first is the last object: put the stub behind it so it can leave.
+        link(&stub);
+        next = first->next.load(std::memory_order_acquire);
+        if (next) {
+            head = next;
+            return first;
+        }
+        return nullptr;
+    }
+
+public:
+    intrusive_queue() : tail(&stub), head(&stub) {}
+
+    intrusive_queue(const intrusive_queue&) = delete;
+    intrusive_queue& operator=(const intrusive_queue&) = delete;
+
+    void push(T* item) {
+        intrusive_queue_hook* const h = item;
+#ifndef NDEBUG
+        bool const was_queued = h->queued.exchange(true, std::memory_order_relaxed);
+        assert(!was_queued && "object pushed while already in a queue");
+#endif
+        link(h);
+    }
+
+    // The oldest object, or nullptr if the queue is empty.
+    T* pop() {
+        spin_backoff backoff;
+        while (consumer_lock.exchange(true, std::memory_order_acquire)) {
+            backoff.pause();
+        }
+        intrusive_queue_hook* const h = unlink();
+        consumer_lock.store(false, std::memory_order_release);
+        if (!h) {
+            return nullptr;
+        }
+#ifndef NDEBUG
+        h->queued.store(false, std::memory_order_relaxed);
+#endif
+        return static_cast<T*>(h);
+    }
+
+    bool try_pop(T*& out) {
+        out = pop();
+        return out != nullptr;
+    }
+};
+
+#endif //INTRUSIVE_QUEUE_H
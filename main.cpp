@@ -4,31 +4,70 @@
 #include <atomic>
 #include <chrono>
 #include <cassert>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <optional>
+#include <random>
 #include <set>
-#include <mutex>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 #include "queue.h" // Include your header file
+#include "queue_set.h"
+#include "baseline_queues.h"
+#include "broadcast_ring.h"
+#include "byte_ring.h"
+#include "delay_queue.h"
+#include "intrusive_queue.h"
+#include "priority_lanes_queue.h"
+#include "relaxed_priority_queue.h"
+#include "shm_queue.h"
+#include "spilling_queue.h"
+#include "block_allocator.h"
+#include "numa_allocator.h"
+#include "perf_counters.h"
+#include "benchmark.h"
+#include "topology.h"
+#include "workload.h"
 
+// Consumers record into their own pop_log; nothing shared is touched per pop.
+// Uniqueness and per-producer FIFO order are checked once the threads joined.
 class TestResults {
 public:
-    std::atomic<int> items_pushed{0};
-    std::atomic<int> items_popped{0};
-    std::atomic<int> successful_pops{0};
-    std::atomic<int> empty_pops{0};
-    std::set<int> popped_values;
-    std::mutex results_mutex;
+    std::vector<pop_log> logs;
+    verification_result summary;
 
-    void record_pop(int value) {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        popped_values.insert(value);
+    TestResults(int num_consumers, int capacity_per_consumer) : logs(num_consumers) {
+        for (auto& log : logs) {
+            log.reserve(capacity_per_consumer);
+        }
     }
 
-    void print_summary() {
+    void verify(int num_producers, int items_per_producer) {
+        summary = verify_pop_logs(logs, num_producers, items_per_producer);
+    }
+
+    void print_summary(int items_pushed) {
         std::cout << "\n=== Test Results Summary ===" << std::endl;
-        std::cout << "Items pushed: " << items_pushed.load() << std::endl;
-        std::cout << "Items popped: " << items_popped.load() << std::endl;
-        std::cout << "Successful pops: " << successful_pops.load() << std::endl;
-        std::cout << "Empty pops: " << empty_pops.load() << std::endl;
-        std::cout << "Unique values popped: " << popped_values.size() << std::endl;
+        std::cout << "Items pushed: " << items_pushed << std::endl;
+        std::cout << "Items popped: " << summary.total_pops + summary.empty_pops << std::endl;
+        std::cout << "Successful pops: " << summary.total_pops << std::endl;
+        std::cout << "Empty pops: " << summary.empty_pops << std::endl;
+        std::cout << "Unique values popped: " << summary.unique_values << std::endl;
+        std::cout << "Duplicate values: " << summary.duplicates << std::endl;
+        std::cout << "Per-producer FIFO violations: " << summary.fifo_violations << std::endl;
     }
 };
 
@@ -36,14 +75,13 @@ public:
 void test_multiple_producers_consumers() {
     std::cout << "\n--- MPMC Test: Multiple Producers/Multiple Consumers ---" << std::endl;
     lock_free_queue<int> queue;
-    TestResults results;
 
     const int num_producers = 4;
     const int num_consumers = 4;
     const int items_per_producer = 2500;
     const int total_items = num_producers * items_per_producer;
 
-    std::atomic<int> items_consumed{0};
+    TestResults results(num_consumers, total_items);
 
     std::vector<std::thread> producers;
     std::vector<std::thread> consumers;
@@ -55,11 +93,10 @@ void test_multiple_producers_consumers() {
     auto start_time = std::chrono::high_resolution_clock::now();
 
     for (int p = 0; p < num_producers; ++p) {
-        producers.emplace_back([&queue, &results, p, items_per_producer]() {
+        producers.emplace_back([&queue, p, items_per_producer]() {
             int start = p * items_per_producer;
             for (int i = 0; i < items_per_producer; ++i) {
                 queue.push(start + i);
-                results.items_pushed.fetch_add(1);
                 // Add small random delay to create more contention
                 if (i % 1000 == 0) {
                     std::this_thread::sleep_for(std::chrono::microseconds(1));
@@ -71,22 +108,14 @@ void test_multiple_producers_consumers() {
 
     // Create consumer threads
     for (int c = 0; c < num_consumers; ++c) {
-        consumers.emplace_back([&queue, &results, &items_consumed, total_items, c]() {
-            int local_consumed = 0;
-            while (items_consumed.load() < total_items) {
-                auto result = queue.pop();
-                if (result) {
-                    results.record_pop(*result);
-                    results.successful_pops.fetch_add(1);
-                    items_consumed.fetch_add(1);
-                    local_consumed++;
-                } else {
-                    results.empty_pops.fetch_add(1);
-                    std::this_thread::yield();
-                }
-                results.items_popped.fetch_add(1);
+        consumers.emplace_back([&queue, &log = results.logs[c], c]() {
+            // Sleeps while the queue is empty; closed means every item has
+            // been handed out.
+            int value = 0;
+            while (queue.wait_pop(value) == queue_op_status::success) {
+                log.record(value);
             }
-            std::cout << "Consumer " << c << " finished, consumed " << local_consumed << " items" << std::endl;
+            std::cout << "Consumer " << c << " finished, consumed " << log.values.size() << " items" << std::endl;
         });
     }
 
@@ -94,7 +123,8 @@ void test_multiple_producers_consumers() {
     for (auto& producer : producers) {
         producer.join();
     }
-    std::cout << "All producers finished" << std::endl;
+    queue.close();
+    std::cout << "All producers finished, queue closed" << std::endl;
 
     // Wait for all consumers to finish
     for (auto& consumer : consumers) {
@@ -105,25 +135,1837 @@ void test_multiple_producers_consumers() {
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
 
-    results.print_summary();
+    results.verify(num_producers, items_per_producer);
+    results.print_summary(total_items);
 
     // Verification
-    assert(results.successful_pops.load() == total_items);
-    assert(results.popped_values.size() == total_items);
+    assert(results.summary.total_pops == total_items);
+    assert(results.summary.unique_values == total_items);
+    assert(results.summary.fifo_violations == 0);
 
     std::cout << "✓ All items successfully processed by multiple consumers" << std::endl;
     std::cout << "Test completed in " << duration.count() << " ms" << std::endl;
-    std::cout << "Throughput: " << (total_items * 1000.0 / duration.count()) << " operations/second" << std::endl;
+    std::cout << "Throughput: " << (total_items * 1000.0 / std::max<long long>(duration.count(), 1)) << " operations/second" << std::endl;
+}
+
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+// Checks memory_usage() with items queued and after draining, for inline,
+// out-of-line and pooled storage.
+template <typename Queue, typename Make>
+void memory_usage_row(const std::string& name, int items, Make make) {
+    Queue queue;
+    for (int i = 0; i < items; ++i) {
+        queue.push(make(i));
+    }
+    queue_memory_usage const full = queue.memory_usage();
+    assert(full.live_counts == memory_count_scope::per_queue);
+    assert(full.live_nodes == static_cast<std::size_t>(items) + 1);
+    assert(full.value_size == 0 || full.live_values == static_cast<std::size_t>(items));
+    for (int i = 0; i < items; ++i) {
+        bool const ok = queue.try_pop().has_value();
+        assert(ok);
+        (void)ok;
+    }
+    queue_memory_usage const empty = queue.memory_usage();
+    assert(empty.live_nodes == 1 && empty.live_values == 0);
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(10) << full.node_size
+              << std::setw(12) << full.live_bytes() / items
+              << std::setw(14) << empty.live_bytes()
+              << std::setw(14) << empty.pooled_nodes << std::endl;
+}
+
+void test_memory_usage(int items) {
+    std::cout << "\n--- Memory usage: " << items << " items queued, then drained ---" << std::endl;
+    std::cout << std::left << std::setw(28) << "queue" << std::right
+              << std::setw(10) << "node B" << std::setw(12) << "B/item" << std::setw(14) << "drained B"
+              << std::setw(14) << "pooled nodes" << std::endl;
+    auto const as_int = [](int i) { return i; };
+    memory_usage_row<lock_free_queue<int>>("lock_free_queue<int>", items, as_int);
+    memory_usage_row<lock_free_queue<std::string>>("lock_free_queue<string>", items,
+                                                    [](int i) { return std::to_string(i); });
+    memory_usage_row<lock_free_queue<int, fixed_block_allocator<int>>>("lock_free_queue<int>+pool", items, as_int);
+}
+#endif
+
+// Polls an empty queue more than 2^count_bits times so head's external count
+// wraps, then checks items still flow and no node is leaked or freed early.
+void test_counter_wraparound() {
+    lock_free_queue<int> queue;
+    std::size_t const polls = lock_free_queue<int>::max_concurrent_threads * 2 + 7;
+    for (std::size_t i = 0; i < polls; ++i) {
+        bool const empty = !queue.try_pop();
+        assert(empty);
+        (void)empty;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        queue.push(i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        std::optional<int> const value = queue.try_pop();
+        assert(value && *value == i);
+    }
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+    assert(queue.memory_usage().live_nodes == 1);
+#else
+    assert(queue.memory_usage().live_counts == memory_count_scope::unavailable);
+    lock_free_queue<int, fixed_block_allocator<int>> const pooled;
+    assert(pooled.memory_usage().live_counts == memory_count_scope::pool_wide);
+#endif
+    std::cout << "✓ Reference counts survived " << polls << " empty polls" << std::endl;
+}
+
+// close(): pushes fail from then on, queued items still drain, and a consumer
+// parked in wait_pop() on an empty queue is woken with closed.
+void test_close() {
+    lock_free_queue<std::string> queue;
+    for (int i = 0; i < 3; ++i) {
+        queue.push("item " + std::to_string(i));
+    }
+    queue.close();
+    queue.close();
+    bool const rejected = !queue.push("late");
+    assert(rejected);
+    (void)rejected;
+    std::string value;
+    for (int i = 0; i < 3; ++i) {
+        queue_op_status const status = queue.nonblocking_pop(value);
+        assert(status == queue_op_status::success && value == "item " + std::to_string(i));
+        (void)status;
+    }
+    assert(queue.nonblocking_pop(value) == queue_op_status::closed);
+    assert(queue.wait_pop(value) == queue_op_status::closed);
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+    assert(queue.memory_usage().live_values == 0);
+#endif
+
+    lock_free_queue<int> idle;
+    std::atomic<queue_op_status> woken_with{queue_op_status::success};
+    std::thread waiter([&idle, &woken_with] {
+        int item = 0;
+        woken_with.store(idle.wait_pop(item));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    idle.close();
+    waiter.join();
+    assert(woken_with.load() == queue_op_status::closed);
+    std::cout << "✓ close() rejected pushes, drained, and woke a parked consumer" << std::endl;
+}
+
+// spread on a two-socket machine: producers and consumers must each cover both
+// packages, otherwise the plan is just cross_socket.
+void test_spread_placement() {
+#ifdef __linux__
+    std::vector<cpu_info> cpus;
+    for (int cpu = 0; cpu < 8; ++cpu) {
+        cpu_info info;
+        info.cpu = cpu;
+        info.core_id = cpu % 4;
+        info.package_id = cpu / 4;
+        info.numa_node = cpu / 4;
+        cpus.push_back(info);
+    }
+    cpu_topology const topology(cpus);
+    placement_plan const plan = plan_placement(topology, placement::spread, 4, 4);
+    assert(plan.feasible());
+    auto packages_of = [&topology](const std::vector<int>& assigned) {
+        std::set<int> packages;
+        for (int cpu : assigned) {
+            packages.insert(topology.find(cpu)->package_id);
+        }
+        return packages.size();
+    };
+    assert(packages_of(plan.producer_cpus) == 2);
+    assert(packages_of(plan.consumer_cpus) == 2);
+    std::set<int> const distinct(plan.producer_cpus.begin(), plan.producer_cpus.end());
+    assert(distinct.size() == 4);
+    (void)packages_of;
+    std::cout << "✓ spread placement put producers and consumers on both sockets" << std::endl;
+#endif
+}
+
+// Runs the same MPMC workload through lock_free_queue and the baseline queues
+// and prints a single comparison table.
+void benchmark_queue_comparison(int items_per_producer) {
+    std::cout << "\n--- Comparison: lock_free_queue vs baseline queues ---" << std::endl;
+    mpmc_workload workload;
+    workload.items_per_producer = items_per_producer;
+    std::cout << workload.num_producers << " producers, " << workload.num_consumers << " consumers, "
+              << workload.total_items() << " items" << std::endl;
+
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<mutex_deque_queue<int>>("mutex+deque", workload));
+    results.push_back(run_mpmc_throughput<mutex_condvar_queue<int>>("mutex+condvar", workload));
+    results.push_back(run_mpmc_throughput<two_lock_queue<int>>("two-lock MS", workload));
+    results.push_back(run_mpmc_throughput<vyukov_bounded_queue<int>>("vyukov bounded", workload));
+    results.push_back(run_mpmc_throughput<lock_free_queue<int>>("lock_free_queue", workload));
+    results.push_back(run_mpmc_throughput<lock_free_queue<int, fixed_block_allocator<int>>>(
+        "lock_free_queue+pool", workload));
+    print_throughput_table(results);
+}
+
+// Runs lock_free_queue under each thread placement strategy so the cost of
+// moving head/tail cache lines between cores and sockets becomes visible.
+void benchmark_placement(int items_per_producer) {
+    std::cout << "\n--- Placement: lock_free_queue throughput per thread placement ---" << std::endl;
+    cpu_topology const topology = cpu_topology::detect();
+    std::cout << topology.cpus().size() << " CPUs, " << topology.packages().size() << " socket(s), "
+              << topology.numa_nodes().size() << " NUMA node(s)" << std::endl;
+
+    std::vector<throughput_result> results;
+    for (placement strategy : {placement::none, placement::smt_siblings, placement::same_socket,
+                               placement::cross_socket, placement::spread}) {
+        mpmc_workload workload;
+        workload.items_per_producer = items_per_producer;
+        placement_plan const plan = plan_placement(topology, strategy,
+                                                   workload.num_producers, workload.num_consumers);
+        if (!plan.feasible()) {
+            std::cout << placement_name(strategy) << ": skipped (" << plan.error << ")" << std::endl;
+            continue;
+        }
+        workload.producer_cpus = plan.producer_cpus;
+        workload.consumer_cpus = plan.consumer_cpus;
+        results.push_back(run_mpmc_throughput<lock_free_queue<int>>(placement_name(strategy), workload));
+    }
+    print_throughput_table(results);
+}
+
+// Producers on one socket, consumers on the other: every node is allocated on
+// the producers' side and freed on the consumers'. Compares the global heap, a
+// single shared pool and per-node pools, with loads served from remote memory
+// counted across all worker threads where perf events are available.
+void benchmark_numa(int items_per_producer) {
+    std::cout << "\n--- NUMA: cross-socket MPMC, node allocator per row ---" << std::endl;
+    cpu_topology const topology = cpu_topology::detect();
+    std::cout << topology.packages().size() << " socket(s), " << topology.numa_nodes().size()
+              << " NUMA node(s)" << std::endl;
+    mpmc_workload workload;
+    workload.items_per_producer = items_per_producer;
+    placement_plan const plan = plan_placement(topology, placement::cross_socket,
+                                               workload.num_producers, workload.num_consumers);
+    if (plan.feasible()) {
+        workload.producer_cpus = plan.producer_cpus;
+        workload.consumer_cpus = plan.consumer_cpus;
+    } else {
+        std::cout << "cross-socket placement unavailable (" << plan.error << "), running unpinned" << std::endl;
+    }
+
+    std::vector<throughput_result> results;
+    std::vector<std::string> remote_reads;
+    auto run = [&]<typename Queue>(const std::string& name) {
+        perf_counter counter = perf_counter::remote_node_reads(true);
+        counter.start();
+        results.push_back(run_mpmc_throughput<Queue>(name, workload));
+        counter.stop();
+        std::optional<std::uint64_t> const reads = counter.read();
+        remote_reads.push_back(reads ? std::to_string(*reads) : "n/a");
+    };
+    run.operator()<lock_free_queue<int>>("lock_free_queue");
+    run.operator()<lock_free_queue<int, fixed_block_allocator<int>>>("lock_free_queue+pool");
+    run.operator()<lock_free_queue<int, numa_allocator<int>>>("lock_free_queue+numa");
+    print_throughput_table(results);
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        std::cout << std::left << std::setw(28) << results[i].name << std::right
+                  << " remote node reads: " << remote_reads[i] << std::endl;
+    }
+}
+
+// Lets the MPMC harness drive a priority queue: each item gets a pseudo-random
+// priority derived from its value, and pops take the (near-)minimum.
+template <typename PriorityQueue>
+struct priority_from_value : PriorityQueue {
+    static std::uint64_t priority_of(int value) {
+        std::uint64_t x = static_cast<std::uint64_t>(value) * 0x9E3779B97F4A7C15ull;
+        return x ^ (x >> 29);
+    }
+
+    void push(int value) { PriorityQueue::push(priority_of(value), value); }
+    bool try_pop(int& out) { return PriorityQueue::pop_min(out); }
+};
+
+// Single-threaded rank error: how many smaller priorities were still queued
+// when each item was popped. 0 for an exact priority queue.
+template <typename PriorityQueue>
+double mean_rank_error(PriorityQueue& queue, int items) {
+    std::multiset<std::uint64_t> shadow;
+    for (int i = 0; i < items; ++i) {
+        std::uint64_t const priority = priority_from_value<PriorityQueue>::priority_of(i);
+        queue.push(priority, i);
+        shadow.insert(priority);
+    }
+    double total_rank = 0;
+    std::uint64_t priority;
+    int value;
+    while (queue.pop_min(priority, value)) {
+        auto const it = shadow.find(priority);
+        total_rank += static_cast<double>(std::distance(shadow.begin(), it));
+        shadow.erase(it);
+    }
+    return total_rank / items;
+}
+
+// relaxed_priority_queue against a mutex-protected std::priority_queue under
+// the MPMC workload, plus how far from the true minimum the relaxed pops land.
+void benchmark_priority(int items_per_producer) {
+    std::cout << "\n--- Priority queues: MPMC throughput with random priorities ---" << std::endl;
+    mpmc_workload workload;
+    workload.items_per_producer = items_per_producer;
+    workload.fifo_order = false;
+    std::cout << workload.num_producers << " producers, " << workload.num_consumers << " consumers, "
+              << workload.total_items() << " items" << std::endl;
+
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<priority_from_value<mutex_priority_queue<int>>>(
+        "mutex std::priority_queue", workload));
+    results.push_back(run_mpmc_throughput<priority_from_value<relaxed_priority_queue<int>>>(
+        "relaxed (MultiQueue)", workload));
+    print_throughput_table(results);
+
+    mutex_priority_queue<int> exact;
+    relaxed_priority_queue<int> relaxed;
+    int const sample = std::min(items_per_producer, 100000);
+    std::cout << "mean rank error over " << sample << " pops: exact " << mean_rank_error(exact, sample)
+              << ", relaxed (" << relaxed.sub_queue_count() << " heaps) "
+              << mean_rank_error(relaxed, sample) << std::endl;
+}
+
+// N separate lock_free_queues popped by polling them most urgent first, the
+// baseline priority_lanes_queue's non-empty mask replaces.
+template <typename T, std::size_t N>
+struct polled_lanes {
+    std::array<lock_free_queue<T>, N> lanes;
+
+    void push(std::size_t lane, T value) { lanes[lane].push(std::move(value)); }
+
+    bool try_pop(T& out) {
+        for (auto& lane : lanes) {
+            if (lane.try_pop(out)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+constexpr std::size_t lane_count = 8;
+
+// priority_lanes_queue whose weights give the last lane one pop in 2^N - 1.
+template <typename T>
+struct weighted_lanes : priority_lanes_queue<T, lane_count> {
+    weighted_lanes() : priority_lanes_queue<T, lane_count>(weights()) {}
+
+    static std::array<unsigned, lane_count> weights() {
+        std::array<unsigned, lane_count> w{};
+        for (std::size_t i = 0; i < lane_count; ++i) {
+            w[i] = 1u << (lane_count - 1 - i);
+        }
+        return w;
+    }
+};
+
+// Lets the MPMC harness drive a lane queue: one item in 16 is urgent (lane 0),
+// the rest go to the last lane, so most pops find the urgent lanes empty.
+template <typename Lanes>
+struct lane_from_value : Lanes {
+    void push(int value) { Lanes::push(value % 16 == 0 ? 0 : lane_count - 1, value); }
+    bool try_pop(int& out) { return Lanes::try_pop(out); }
+};
+
+// Keeps lane 0 permanently busy and counts how often, and how late, items
+// queued on the last lane get served within `pops` pops.
+template <typename Lanes>
+void starvation_row(const std::string& name, int pops) {
+    Lanes queue;
+    int const urgent = 0;
+    int const background = 1;
+    for (int i = 0; i < 4; ++i) {
+        queue.push(0, urgent);
+    }
+    for (int i = 0; i < pops; ++i) {
+        queue.push(lane_count - 1, background);
+    }
+    int served = 0;
+    int longest_gap = 0;
+    int gap = 0;
+    int value;
+    for (int i = 0; i < pops && queue.try_pop(value); ++i) {
+        if (value == urgent) {
+            queue.push(0, urgent);
+            longest_gap = std::max(longest_gap, ++gap);
+        } else {
+            ++served;
+            gap = 0;
+        }
+    }
+    std::cout << std::left << std::setw(28) << name << std::right
+              << std::setw(14) << served
+              << std::setw(14) << longest_gap << std::endl;
+}
+
+// priority_lanes_queue against polling separate queues under the MPMC
+// workload, then how each handles a lane that never runs dry.
+void benchmark_lanes(int items_per_producer) {
+    std::cout << "\n--- Priority lanes: " << lane_count << " lanes, 1 in 16 items urgent ---" << std::endl;
+    mpmc_workload workload;
+    workload.items_per_producer = items_per_producer;
+    workload.fifo_order = false;
+    std::cout << workload.num_producers << " producers, " << workload.num_consumers << " consumers, "
+              << workload.total_items() << " items" << std::endl;
+
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<lane_from_value<polled_lanes<int, lane_count>>>(
+        "polled lock_free_queues", workload));
+    results.push_back(run_mpmc_throughput<lane_from_value<priority_lanes_queue<int, lane_count>>>(
+        "priority_lanes (strict)", workload));
+    results.push_back(run_mpmc_throughput<lane_from_value<weighted_lanes<int>>>(
+        "priority_lanes (weighted)", workload));
+    print_throughput_table(results);
+
+    int const pops = 100000;
+    std::cout << "\nlane 0 never empty, " << pops << " pops:" << std::endl;
+    std::cout << std::left << std::setw(28) << "queue" << std::right
+              << std::setw(14) << "last lane" << std::setw(14) << "max gap" << std::endl;
+    starvation_row<polled_lanes<int, lane_count>>("polled lock_free_queues", pops);
+    starvation_row<priority_lanes_queue<int, lane_count>>("priority_lanes (strict)", pops);
+    starvation_row<weighted_lanes<int>>("priority_lanes (weighted)", pops);
+}
+
+// What retry logic did before delay_queue: pop an item, and if it is not due
+// yet push it back and try again.
+template <typename T>
+class repush_delay_queue {
+private:
+    using clock = std::chrono::steady_clock;
+    lock_free_queue<std::pair<clock::time_point, T>> items;
+
+public:
+    std::atomic<long long> repushes{0};
+
+    void push_at(clock::time_point deadline, T value) { items.push({deadline, std::move(value)}); }
+
+    bool pop_due(clock::time_point now, T& out) {
+        std::pair<clock::time_point, T> item;
+        if (!items.try_pop(item)) {
+            return false;
+        }
+        if (item.first > now) {
+            items.push(std::move(item));
+            repushes.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        out = std::move(item.second);
+        return true;
+    }
+};
+
+// Producers schedule items 0-20 ms ahead while consumers poll pop_due();
+// checks each item arrives exactly once and never early, and reports how late.
+template <typename DelayQueue>
+latency_summary run_timer_lateness(DelayQueue& queue, int items, bool& verified) {
+    using clock = std::chrono::steady_clock;
+    int const producers = 2;
+    int const consumers = 2;
+    std::vector<clock::time_point> deadlines(items);
+    std::vector<std::atomic<int>> seen(items);
+    std::vector<std::vector<std::uint64_t>> lateness(consumers);
+    std::atomic<int> delivered{0};
+    std::atomic<bool> early{false};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            std::mt19937_64 rng(p + 1);
+            std::uniform_int_distribution<int> delay_us(0, 20000);
+            for (int i = p; i < items; i += producers) {
+                deadlines[i] = clock::now() + std::chrono::microseconds(delay_us(rng));
+                queue.push_at(deadlines[i], i);
+            }
+        });
+    }
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&, c] {
+            int value;
+            while (delivered.load(std::memory_order_relaxed) < items) {
+                clock::time_point const now = clock::now();
+                if (!queue.pop_due(now, value)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (deadlines[value] > now) {
+                    early.store(true);
+                }
+                seen[value].fetch_add(1, std::memory_order_relaxed);
+                lateness[c].push_back(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - deadlines[value]).count()));
+                delivered.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    verified = !early.load();
+    for (auto& count : seen) {
+        verified = verified && count.load() == 1;
+    }
+    std::vector<std::uint64_t> all;
+    for (auto& samples : lateness) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    return summarize_latencies(all);
+}
+
+// ns per insert of `timers` random deadlines, from `threads` threads at once.
+template <typename Push>
+double insert_ns(int timers, int threads, Push push) {
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            for (int i = t; i < timers; i += threads) {
+                push(rng(), i);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / timers;
 }
 
-int main() {
-    std::cout << "Testing Lock-Free Queue Implementation - MPMC Test Only" << std::endl;
+// delay_queue's real-time delivery against the pop-and-repush loop it
+// replaces, its insertion cost as the number of pending timers grows against a
+// mutex-protected binary heap, and a drain in simulated time checking nothing
+// fires early or more than a tick late.
+void benchmark_delay_queue(int timers) {
+    using clock = std::chrono::steady_clock;
+    std::cout << "\n--- Delay queue: timing wheel vs binary heap ---" << std::endl;
+    auto const horizon = std::chrono::seconds(10);
+    auto const horizon_ns = static_cast<std::uint64_t>(std::chrono::nanoseconds(horizon).count());
+    int const threads = 4;
+
+    int const live_items = std::min(timers, 20000);
+    std::cout << live_items << " items 0-20 ms ahead, 2 producers, 2 consumers, lateness:" << std::endl;
+    print_latency_header("queue");
+    bool verified = false;
+    delay_queue<int> live_wheel;
+    print_latency_row("delay_queue", run_timer_lateness(live_wheel, live_items, verified));
+    bool all_verified = verified;
+    repush_delay_queue<int> repush;
+    print_latency_row("lock_free_queue re-push", run_timer_lateness(repush, live_items, verified));
+    all_verified = all_verified && verified;
+    std::cout << "re-push loop pushed items back " << repush.repushes.load() << " times" << std::endl;
+    if (!all_verified) {
+        throw std::runtime_error("an item was delivered early, twice or not at all");
+    }
+
+    std::cout << "\n" << std::left << std::setw(28) << "pending timers" << std::right
+              << std::setw(18) << "wheel ns/insert" << std::setw(18) << "heap ns/insert" << std::endl;
+    for (int count : {timers / 64, timers / 8, timers}) {
+        delay_queue<int> wheel;
+        clock::time_point const base = clock::now();
+        double const wheel_ns = insert_ns(count, threads, [&](std::uint64_t r, int i) {
+            wheel.push_at(base + std::chrono::nanoseconds(r % horizon_ns), i);
+        });
+        mutex_priority_queue<int> heap;
+        double const heap_ns = insert_ns(count, threads, [&](std::uint64_t r, int i) {
+            heap.push(r % horizon_ns, i);
+        });
+        std::cout << std::left << std::setw(28) << count << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(18) << wheel_ns << std::setw(18) << heap_ns << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+
+    // Drain in simulated time, one tick per step.
+    delay_queue<int> wheel;
+    clock::time_point const base = clock::now();
+    std::vector<clock::time_point> deadlines(timers);
+    std::mt19937_64 rng(42);
+    for (int i = 0; i < timers; ++i) {
+        deadlines[i] = base + std::chrono::nanoseconds(rng() % horizon_ns);
+        wheel.push_at(deadlines[i], i);
+    }
+    std::vector<bool> seen(timers);
+    int delivered = 0;
+    bool ok = true;
+    auto const start = clock::now();
+    for (clock::time_point now = base; delivered < timers && now <= base + 2 * horizon; now += wheel.tick_length()) {
+        int value;
+        while (wheel.pop_due(now, value)) {
+            // Never early, and at most one tick late plus the rounding of
+            // `base` onto the wheel's tick grid.
+            ok = ok && !seen[value] && deadlines[value] <= now && now - deadlines[value] < 2 * wheel.tick_length();
+            seen[value] = true;
+            ++delivered;
+        }
+    }
+    auto const drain_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start).count();
+    ok = ok && delivered == timers;
+    std::cout << "drained " << delivered << " timers over " << horizon.count() << " s of simulated time in "
+              << drain_ms << " ms: " << (ok ? "ok" : "FAILED") << std::endl;
+    if (!ok) {
+        throw std::runtime_error("delay_queue delivered a timer early, late, twice or not at all");
+    }
+}
+
+// A cache line of payload, so each copy the fan-out makes is visible.
+struct fanout_message {
+    std::uint64_t sequence = 0;
+    std::uint64_t body[7] = {};
+};
+
+struct fanout_result {
+    std::string name;
+    double seconds = 0;
+    bool verified = false;
+};
+
+// Runs one producer and `subscribers` reader threads; read(i, on_message)
+// must deliver messages to subscriber i in publish order and return how many
+// it delivered.
+template <typename Publish, typename Read>
+fanout_result run_fanout(const std::string& name, int subscribers, int messages, Publish publish, Read read) {
+    std::atomic<bool> ordered{true};
+    std::vector<std::thread> readers;
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < subscribers; ++i) {
+        readers.emplace_back([&, i] {
+            std::uint64_t expected = 0;
+            auto on_message = [&](const fanout_message& m) {
+                if (m.sequence != expected || m.body[6] != expected * 7) {
+                    ordered.store(false, std::memory_order_relaxed);
+                }
+                ++expected;
+            };
+            while (expected < static_cast<std::uint64_t>(messages)) {
+                if (read(i, on_message) == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    fanout_message m;
+    for (int n = 0; n < messages; ++n) {
+        m.sequence = static_cast<std::uint64_t>(n);
+        m.body[6] = m.sequence * 7;
+        publish(m);
+    }
+    for (auto& r : readers) {
+        r.join();
+    }
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+    return {name, elapsed.count(), ordered.load()};
+}
+
+fanout_result run_fanout_ring(const std::string& name, ring_wait wait, int subscribers, int messages) {
+    broadcast_ring<fanout_message> ring(4096, subscribers, wait);
+    std::vector<broadcast_ring<fanout_message>::subscription> subs;
+    for (int i = 0; i < subscribers; ++i) {
+        subs.push_back(ring.subscribe());
+    }
+    return run_fanout(name, subscribers, messages,
+                      [&](const fanout_message& m) { ring.publish(m); },
+                      [&](int i, auto& on_message) { return ring.wait_consume(subs[i], on_message); });
+}
+
+// The approach broadcast_ring replaces: a copy of every message pushed into
+// one lock_free_queue per subscriber.
+fanout_result run_fanout_queues(const std::string& name, int subscribers, int messages) {
+    std::vector<std::unique_ptr<lock_free_queue<fanout_message>>> queues;
+    for (int i = 0; i < subscribers; ++i) {
+        queues.push_back(std::make_unique<lock_free_queue<fanout_message>>());
+    }
+    return run_fanout(name, subscribers, messages,
+                      [&](const fanout_message& m) {
+                          for (auto& q : queues) {
+                              q->push(m);
+                          }
+                      },
+                      [&](int i, auto& on_message) {
+                          fanout_message m;
+                          std::size_t n = 0;
+                          while (n < 256 && queues[i]->try_pop(m)) {
+                              on_message(m);
+                              ++n;
+                          }
+                          return n;
+                      });
+}
+
+// One producer fanning messages out to several subscribers: a broadcast_ring
+// under each wait strategy against per-subscriber lock_free_queue copies.
+void benchmark_fanout(int messages) {
+    int const subscribers = 4;
+    std::cout << "\n--- Fan-out: 1 producer, " << subscribers << " subscribers, " << messages
+              << " messages of " << sizeof(fanout_message) << " bytes ---" << std::endl;
+    std::vector<fanout_result> results;
+    results.push_back(run_fanout_queues("lock_free_queue per sub", subscribers, messages));
+    if (std::thread::hardware_concurrency() > static_cast<unsigned>(subscribers)) {
+        results.push_back(run_fanout_ring("broadcast_ring / spin", ring_wait::busy_spin, subscribers, messages));
+    } else {
+        std::cout << "broadcast_ring / spin: skipped (needs a core per thread)" << std::endl;
+    }
+    results.push_back(run_fanout_ring("broadcast_ring / backoff", ring_wait::backoff, subscribers, messages));
+    results.push_back(run_fanout_ring("broadcast_ring / blocking", ring_wait::blocking, subscribers, messages));
+
+    std::cout << std::left << std::setw(28) << "fan-out" << std::right
+              << std::setw(12) << "time (ms)" << std::setw(18) << "deliveries/s (M)"
+              << std::setw(10) << "check" << std::endl;
+    for (const auto& r : results) {
+        std::cout << std::left << std::setw(28) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.seconds * 1000
+                  << std::setprecision(3)
+                  << std::setw(18) << static_cast<double>(messages) * subscribers / r.seconds / 1e6
+                  << std::setw(10) << (r.verified ? "ok" : "FAILED") << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " delivered messages out of order");
+        }
+    }
+}
+
+// Message object living in a caller-owned pool, as the intrusive queue's
+// users keep them.
+struct pooled_message : intrusive_queue_hook {
+    int value = 0;
+    std::uint64_t body[6] = {};
+};
+
+// Lets the MPMC harness pass pooled messages: item v travels as &pool[v].
+template <typename Queue>
+struct pooled_message_adapter {
+    static inline std::vector<pooled_message>* pool = nullptr;
+    Queue queue;
+
+    void push(int value) {
+        pooled_message& m = (*pool)[value];
+        m.value = value;
+        queue.push(&m);
+    }
+
+    bool try_pop(int& out) {
+        pooled_message* m;
+        if (!queue.try_pop(m)) {
+            return false;
+        }
+        out = m->value;
+        return true;
+    }
+};
+
+// intrusive_queue linking pooled messages directly, against lock_free_queue
+// carrying pointers to them (one node allocation per push).
+void benchmark_intrusive(int items_per_producer) {
+    std::cout << "\n--- Intrusive queue: pooled messages, no per-push allocation ---" << std::endl;
+    mpmc_workload workload;
+    workload.items_per_producer = items_per_producer;
+    std::cout << workload.num_producers << " producers, " << workload.num_consumers << " consumers, "
+              << workload.total_items() << " items" << std::endl;
+    std::vector<pooled_message> pool(workload.total_items());
+
+    std::vector<throughput_result> results;
+    pooled_message_adapter<lock_free_queue<pooled_message*>>::pool = &pool;
+    results.push_back(run_mpmc_throughput<pooled_message_adapter<lock_free_queue<pooled_message*>>>(
+        "lock_free_queue<T*>", workload));
+    using pooled_pointer_queue = lock_free_queue<pooled_message*, fixed_block_allocator<pooled_message*>>;
+    pooled_message_adapter<pooled_pointer_queue>::pool = &pool;
+    results.push_back(run_mpmc_throughput<pooled_message_adapter<pooled_pointer_queue>>(
+        "lock_free_queue<T*>+pool", workload));
+    pooled_message_adapter<intrusive_queue<pooled_message>>::pool = &pool;
+    results.push_back(run_mpmc_throughput<pooled_message_adapter<intrusive_queue<pooled_message>>>(
+        "intrusive_queue", workload));
+    print_throughput_table(results);
+}
+
+// Size of message i of producer p: 16 to 527 bytes, the same for every queue.
+std::size_t byte_message_size(int producer, int i) {
+    std::uint64_t x = (static_cast<std::uint64_t>(producer) << 32 | static_cast<std::uint32_t>(i)) *
+                      0x9E3779B97F4A7C15ull;
+    return 16 + static_cast<std::size_t>((x >> 40) % 512);
+}
+
+// Fills a message: its id in the first 4 bytes, then a pattern derived from it.
+void fill_byte_message(std::byte* data, std::size_t size, int id) {
+    std::memcpy(data, &id, sizeof(id));
+    for (std::size_t i = sizeof(id); i < size; ++i) {
+        data[i] = static_cast<std::byte>(id + i);
+    }
+}
+
+// Checks a message's pattern and returns its id, or -1 if it is corrupt.
+int check_byte_message(const std::byte* data, std::size_t size) {
+    int id;
+    std::memcpy(&id, data, sizeof(id));
+    for (std::size_t i = sizeof(id); i < size; ++i) {
+        if (data[i] != static_cast<std::byte>(id + i)) {
+            return -1;
+        }
+    }
+    return id;
+}
+
+// 4 producers and 4 consumers moving variable-size messages; write(p, i, id)
+// sends one, read(on_message) receives at most one and returns whether it did.
+// Each consumer logs the ids it receives (-1 for a corrupt message) to its own
+// pop_log, so the timed loop shares nothing but the queue.
+template <typename Write, typename Read>
+throughput_result run_byte_messages(const std::string& name, int per_producer, Write write, Read read) {
+    int const producers = 4;
+    int const consumers = 4;
+    int const total = producers * per_producer;
+    std::atomic<bool> producers_done{false};
+    std::vector<pop_log> logs(consumers);
+    for (auto& log : logs) {
+        log.reserve(total);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; ++p) {
+        producer_threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; ++i) {
+                write(p, i, p * per_producer + i);
+            }
+        });
+    }
+    std::vector<std::thread> consumer_threads;
+    for (int c = 0; c < consumers; ++c) {
+        consumer_threads.emplace_back([&, &log = logs[c]] {
+            auto on_message = [&log](const std::byte* data, std::size_t size) {
+                log.record(check_byte_message(data, size));
+            };
+            for (;;) {
+                bool const done = producers_done.load(std::memory_order_acquire);
+                if (read(on_message)) {
+                    continue;
+                }
+                if (done) {
+                    break;
+                }
+                ++log.empty_pops;
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (auto& t : producer_threads) {
+        t.join();
+    }
+    producers_done.store(true, std::memory_order_release);
+    for (auto& t : consumer_threads) {
+        t.join();
+    }
+    std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+
+    verification_result const check = verify_pop_logs(logs, producers, per_producer);
+    throughput_result result;
+    result.name = name;
+    result.elapsed_ms = elapsed.count();
+    result.ops_per_second = total / (elapsed.count() / 1000.0);
+    result.empty_pops = check.empty_pops;
+    result.verified = check.ok(total);
+    return result;
+}
+
+// byte_ring's in-place reserve/commit and read/release against handing each
+// message over as a std::vector<char> through lock_free_queue.
+void benchmark_byte_messages(int per_producer) {
+    std::cout << "\n--- Variable-size byte messages: 16-527 bytes, 4 producers, 4 consumers, "
+              << 4 * per_producer << " messages ---" << std::endl;
+    std::vector<throughput_result> results;
+
+    lock_free_queue<std::vector<char>> vectors;
+    results.push_back(run_byte_messages(
+        "lock_free_queue<vector>", per_producer,
+        [&](int p, int i, int id) {
+            std::vector<char> message(byte_message_size(p, i));
+            fill_byte_message(reinterpret_cast<std::byte*>(message.data()), message.size(), id);
+            vectors.push(std::move(message));
+        },
+        [&](auto& on_message) {
+            std::vector<char> message;
+            if (!vectors.try_pop(message)) {
+                return false;
+            }
+            on_message(reinterpret_cast<const std::byte*>(message.data()), message.size());
+            return true;
+        }));
+
+    byte_ring ring(1 << 20);
+    results.push_back(run_byte_messages(
+        "byte_ring", per_producer,
+        [&](int p, int i, int id) {
+            byte_ring::reservation r = ring.reserve(byte_message_size(p, i));
+            fill_byte_message(r.data, r.size, id);
+            ring.commit(r);
+        },
+        [&](auto& on_message) {
+            byte_ring::message m;
+            if (!ring.try_read(m)) {
+                return false;
+            }
+            on_message(m.data, m.size);
+            ring.release(m);
+            return true;
+        }));
+    print_throughput_table(results);
+    for (const auto& r : results) {
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " lost, duplicated or corrupted messages");
+        }
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+struct shm_message {
+    std::uint64_t sequence;
+    std::uint64_t body[3];
+};
+
+shm_message make_shm_message(std::uint64_t n) { return {n, {n * 3, n * 5, n * 7}}; }
+
+bool is_shm_message(const shm_message& m, std::uint64_t n) {
+    return m.sequence == n && m.body[0] == n * 3 && m.body[1] == n * 5 && m.body[2] == n * 7;
+}
+
+// Runs consume() in a forked child and produce() in this process; true if
+// the child exited cleanly (consume() returned true).
+template <typename Produce, typename Consume>
+bool run_two_processes(Produce produce, Consume consume) {
+    pid_t const child = fork();
+    if (child < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    if (child == 0) {
+        bool ok = false;
+        try {
+            ok = consume();
+        } catch (...) {
+        }
+        _exit(ok ? 0 : 1);
+    }
+    produce();
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Producer process to consumer process through a shm_queue.
+throughput_result run_shm_pipeline(const std::string& name, int messages) {
+    std::string const segment = "/lfq_bench_" + std::to_string(getpid());
+    shm_queue<shm_message>::unlink(segment);
+    auto queue = shm_queue<shm_message>::create(segment, 4096);
+    auto const start = std::chrono::steady_clock::now();
+    bool const ok = run_two_processes(
+        [&] {
+            for (int n = 0; n < messages; ++n) {
+                queue.push(make_shm_message(n));
+            }
+        },
+        [&] {
+            auto reader = shm_queue<shm_message>::open(segment);
+            shm_message m;
+            spin_backoff backoff;
+            for (int n = 0; n < messages;) {
+                if (!reader.try_pop(m)) {
+                    backoff.pause();
+                    continue;
+                }
+                backoff.reset();
+                if (!is_shm_message(m, n++)) {
+                    return false;
+                }
+            }
+            return true;
+        });
+    std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+    shm_queue<shm_message>::unlink(segment);
+    return {name, elapsed.count(), messages / (elapsed.count() / 1000.0), 0, ok, 0};
+}
+
+// The same pipeline over a Unix domain socket, one write() per message.
+throughput_result run_socket_pipeline(const std::string& name, int messages) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        throw std::system_error(errno, std::generic_category(), "socketpair");
+    }
+    auto const start = std::chrono::steady_clock::now();
+    bool const ok = run_two_processes(
+        [&] {
+            close(fds[1]);
+            for (int n = 0; n < messages; ++n) {
+                shm_message const m = make_shm_message(n);
+                if (write(fds[0], &m, sizeof(m)) != static_cast<ssize_t>(sizeof(m))) {
+                    break;
+                }
+            }
+            close(fds[0]);
+        },
+        [&] {
+            close(fds[0]);
+            std::vector<shm_message> buffer(256);
+            std::size_t filled = 0;  // bytes
+            int n = 0;
+            while (n < messages) {
+                ssize_t const got = read(fds[1], reinterpret_cast<char*>(buffer.data()) + filled,
+                                         buffer.size() * sizeof(shm_message) - filled);
+                if (got <= 0) {
+                    return false;
+                }
+                filled += static_cast<std::size_t>(got);
+                std::size_t const whole = filled / sizeof(shm_message);
+                for (std::size_t i = 0; i < whole; ++i) {
+                    if (!is_shm_message(buffer[i], n++)) {
+                        return false;
+                    }
+                }
+                filled -= whole * sizeof(shm_message);
+                std::memmove(buffer.data(), buffer.data() + whole, filled);
+            }
+            return true;
+        });
+    close(fds[0]);
+    close(fds[1]);
+    std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+    return {name, elapsed.count(), messages / (elapsed.count() / 1000.0), 0, ok, 0};
+}
+
+// A child process dies holding a slot, first mid-write and then mid-read; the
+// parent must get every other item through in order.
+bool test_shm_dead_peers() {
+    std::string const segment = "/lfq_dead_peer_" + std::to_string(getpid());
+    shm_queue<shm_message>::unlink(segment);
+    auto queue = shm_queue<shm_message>::create(segment, 8);
+    auto claim_and_die = [&](bool writer) {
+        return run_two_processes([] {}, [&] {
+            auto q = shm_queue<shm_message>::open(segment);
+            shm_queue<shm_message>::slot_ref r;
+            bool const claimed = writer ? q.try_begin_push(r) : q.try_begin_pop(r);
+            _exit(claimed ? 0 : 1);
+            return false;
+        });
+    };
+    auto pop_in_order = [&](std::uint64_t first, std::uint64_t count) {
+        shm_message m;
+        for (std::uint64_t n = first; n < first + count;) {
+            // Generous bound: a stuck slot is only checked every few
+            // thousand attempts.
+            int attempts = 0;
+            while (!queue.try_pop(m)) {
+                if (++attempts > 1000000) {
+                    return false;
+                }
+            }
+            if (!is_shm_message(m, n++)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool ok = claim_and_die(true);
+    for (std::uint64_t n = 0; n < 3; ++n) {
+        queue.push(make_shm_message(n));
+    }
+    ok = ok && pop_in_order(0, 3);
+
+    for (std::uint64_t n = 100; n < 100 + queue.capacity(); ++n) {
+        queue.push(make_shm_message(n));
+    }
+    ok = ok && claim_and_die(false);
+    ok = ok && pop_in_order(101, queue.capacity() - 1);
+    for (std::uint64_t n = 200; n < 200 + queue.capacity(); ++n) {
+        queue.push(make_shm_message(n));  // the first one has to reclaim the dead reader's slot
+    }
+    ok = ok && pop_in_order(200, queue.capacity());
+    shm_queue<shm_message>::unlink(segment);
+    return ok;
+}
+
+// Two-process pipeline through a shm_queue segment against a Unix domain
+// socket, plus recovery from peers that die holding a slot.
+void benchmark_shm(int messages) {
+    std::cout << "\n--- Interprocess: producer process to consumer process, " << messages << " messages of "
+              << sizeof(shm_message) << " bytes ---" << std::endl;
+    std::vector<throughput_result> results;
+    results.push_back(run_socket_pipeline("unix domain socket", messages));
+    results.push_back(run_shm_pipeline("shm_queue", messages));
+    print_throughput_table(results);
+    bool const recovered = test_shm_dead_peers();
+    std::cout << "dead writer / dead reader recovery: " << (recovered ? "ok" : "FAILED") << std::endl;
+    for (const auto& r : results) {
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " lost, reordered or corrupted messages");
+        }
+    }
+    if (!recovered) {
+        throw std::runtime_error("shm_queue did not recover from a dead peer");
+    }
+}
+
+// A fresh, empty directory for spill segments, unique to this process.
+std::filesystem::path make_spill_directory(const std::string& tag) {
+    std::filesystem::path const dir =
+        std::filesystem::temp_directory_path() / ("lfq_spill_" + tag + "_" + std::to_string(getpid()));
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+// RSS growth from holding items values in a queue, then a single-threaded
+// drain that checks they come out in order.
+template <typename Queue>
+void spill_rss_row(const std::string& name, Queue& queue, int items) {
+    std::size_t const before = resident_set_bytes();
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < items; ++i) {
+        queue.push(static_cast<std::uint64_t>(i));
+    }
+    auto const filled = std::chrono::steady_clock::now();
+    std::size_t const queued = resident_set_bytes();
+    std::uint64_t value = 0;
+    for (int i = 0; i < items; ++i) {
+        if (!queue.try_pop(value) || value != static_cast<std::uint64_t>(i)) {
+            throw std::runtime_error(name + " lost or reordered items");
+        }
+    }
+    auto const drained = std::chrono::steady_clock::now();
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(14) << (static_cast<double>(queued) - static_cast<double>(before)) / (1 << 20)
+              << std::setw(10) << std::chrono::duration<double, std::milli>(filled - start).count()
+              << std::setw(10) << std::chrono::duration<double, std::milli>(drained - filled).count() << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+// Lets the MPMC harness default-construct a spilling_queue with a small
+// memory threshold, so most of the run goes through the disk.
+struct spilling_queue_adapter {
+    static inline std::string directory;
+    spilling_queue<int> queue{spill_options{directory, 4096, 1 << 16, 4096, 1024, false}};
+
+    void push(int value) { queue.push(value); }
+    bool try_pop(int& out) { return queue.try_pop(out); }
+};
+
+// A child process spills, pops part of the way into the spilled items and
+// exits without running destructors. A queue reopened on its directory must
+// deliver every spilled item it had not popped, in order; the last batch it
+// paged in may come out again.
+bool test_spill_crash_recovery(const std::filesystem::path& dir) {
+    constexpr std::uint64_t items = 200000;
+    constexpr std::uint64_t popped = 50000;
+    spill_options options{dir.string(), 10000, 16384, 4096, 4096, true};
+    bool const child_ok = run_two_processes([] {}, [&] {
+        spilling_queue<std::uint64_t> queue(options);
+        for (std::uint64_t i = 0; i < items; ++i) {
+            queue.push(i);
+        }
+        std::uint64_t value = 0;
+        for (std::uint64_t i = 0; i < popped; ++i) {
+            if (!queue.try_pop(value) || value != i) {
+                return false;
+            }
+        }
+        _exit(0);  // as a crash would: nothing synced or cleaned up
+        return true;
+    });
+
+    options.keep_on_close = false;
+    spilling_queue<std::uint64_t> queue(options);
+    std::size_t const recovered = queue.stats().recovered;
+    std::uint64_t value = 0;
+    std::uint64_t next = 0;
+    std::uint64_t first = 0;
+    bool ok = child_ok && queue.try_pop(first) && first >= options.memory_threshold && first <= popped;
+    for (next = first + 1; ok && queue.try_pop(value); ++next) {
+        ok = value == next;
+    }
+    ok = ok && next == items;
+    std::cout << "crash recovery: " << recovered << " spilled items found, delivery resumed at " << first
+              << " (the child had popped " << popped << "): " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+// Memory held by a deep backlog with and without spilling, MPMC throughput
+// through the spill path, and recovery of spilled items after a crash.
+void benchmark_spill(int items) {
+    std::filesystem::path const dir = make_spill_directory("bench");
+    std::size_t const threshold = std::max(items / 16, 1);
+    std::cout << "\n--- Spilling queue: " << items << " items queued, memory threshold " << threshold
+              << " ---" << std::endl;
+    std::cout << std::left << std::setw(28) << "queue" << std::right << std::setw(14) << "RSS +MiB"
+              << std::setw(10) << "fill ms" << std::setw(10) << "drain ms" << std::endl;
+    spill_stats stats;
+    {
+        spilling_queue<std::uint64_t> queue(spill_options{dir.string(), threshold});
+        spill_rss_row("spilling_queue", queue, items);
+        stats = queue.stats();
+    }
+    {
+        lock_free_queue<std::uint64_t> queue;
+        spill_rss_row("lock_free_queue", queue, items);
+    }
+    std::cout << "spilled " << stats.spilled << " items, " << stats.msync_calls << " msync calls" << std::endl;
+
+    mpmc_workload workload;
+    workload.items_per_producer = std::max(items / 8, 1);
+    spilling_queue_adapter::directory = dir.string();
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<lock_free_queue<int>>("lock_free_queue", workload));
+    results.push_back(run_mpmc_throughput<spilling_queue_adapter>("spilling_queue", workload));
+    print_throughput_table(results);
+
+    bool const recovered = test_spill_crash_recovery(dir);
+    std::filesystem::remove_all(dir);
+    for (const auto& r : results) {
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " lost, duplicated or reordered items");
+        }
+    }
+    if (!recovered) {
+        throw std::runtime_error("spilling_queue did not recover its spilled items");
+    }
+}
+#endif
+
+struct select_result {
+    std::string name;
+    double elapsed_ms;
+    double cpu_ms;           // process CPU time, producers included
+    long long empty_polls;   // pops or scans that found nothing
+    bool verified;
+};
+
+// Workers serving a group of queues fed in bursts with idle gaps between
+// them. serve(consumed_sum, empty_polls) runs in each worker until it decides
+// the work is over; finish() is called once the producers are done.
+template <typename Serve, typename Finish>
+select_result run_select_workload(const std::string& name, std::vector<lock_free_queue<int>>& queues,
+                                  int items, int workers, Serve serve, Finish finish) {
+    int const producers = 2;
+    int const burst = 64;
+    std::atomic<long long> consumed_sum{0};
+    std::atomic<long long> empty_polls{0};
+    std::clock_t const cpu_start = std::clock();
+    auto const start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> consumer_threads;
+    for (int w = 0; w < workers; ++w) {
+        consumer_threads.emplace_back([&] { serve(consumed_sum, empty_polls); });
+    }
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; ++p) {
+        producer_threads.emplace_back([&, p] {
+            for (int i = p; i < items; i += producers) {
+                queues[static_cast<std::size_t>(i) % queues.size()].push(i);
+                if (i / producers % burst == burst - 1) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+        });
+    }
+    for (auto& t : producer_threads) {
+        t.join();
+    }
+    finish();
+    for (auto& t : consumer_threads) {
+        t.join();
+    }
+    std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+    double const cpu_ms = 1000.0 * static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    long long const expected = static_cast<long long>(items) * (items - 1) / 2;
+    return {name, elapsed.count(), cpu_ms, empty_polls.load(), consumed_sum.load() == expected};
+}
+
+// Idle-heavy traffic over several queues: workers that spin through every
+// queue calling try_pop, against workers sleeping in queue_set::select().
+void benchmark_select(int items) {
+    std::size_t const num_queues = 8;
+    int const workers = 2;
+    std::cout << "\n--- Select: " << workers << " workers serving " << num_queues << " queues, " << items
+              << " items in bursts of 64 every 200 us ---" << std::endl;
+    std::vector<select_result> results;
+    {
+        std::vector<lock_free_queue<int>> queues(num_queues);
+        std::atomic<bool> producers_done{false};
+        results.push_back(run_select_workload(
+            "poll every queue", queues, items, workers,
+            [&](std::atomic<long long>& sum, std::atomic<long long>& empty) {
+                int value = 0;
+                long long local_sum = 0;
+                long long local_empty = 0;
+                for (;;) {
+                    bool const done = producers_done.load(std::memory_order_acquire);
+                    bool found = false;
+                    for (auto& q : queues) {
+                        if (q.try_pop(value)) {
+                            local_sum += value;
+                            found = true;
+                        } else {
+                            ++local_empty;
+                        }
+                    }
+                    if (!found && done) {
+                        break;
+                    }
+                }
+                sum += local_sum;
+                empty += local_empty;
+            },
+            [&] { producers_done.store(true, std::memory_order_release); }));
+    }
+    {
+        std::vector<lock_free_queue<int>> queues(num_queues);
+        queue_set set;
+        for (auto& q : queues) {
+            set.add(q);
+        }
+        results.push_back(run_select_workload(
+            "queue_set::select", queues, items, workers,
+            [&](std::atomic<long long>& sum, std::atomic<long long>& empty) {
+                int value = 0;
+                long long local_sum = 0;
+                long long local_empty = 0;
+                std::size_t position = 0;
+                while (std::optional<std::size_t> const ready = set.select(position)) {
+                    if (queues[*ready].try_pop(value)) {
+                        local_sum += value;
+                    } else {
+                        ++local_empty;  // another worker got there first
+                    }
+                }
+                sum += local_sum;
+                empty += local_empty;
+            },
+            [&] { set.close(); }));
+    }
+
+    std::cout << std::left << std::setw(24) << "workers" << std::right << std::setw(12) << "time (ms)"
+              << std::setw(12) << "CPU ms" << std::setw(16) << "empty polls" << std::setw(8) << "check" << std::endl;
+    for (const auto& r : results) {
+        std::cout << std::left << std::setw(24) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << r.elapsed_ms << std::setw(12) << r.cpu_ms << std::setw(16) << r.empty_polls
+                  << std::setw(8) << (r.verified ? "ok" : "FAILED") << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+    for (const auto& r : results) {
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " lost or duplicated items");
+        }
+    }
+}
+
+// Round-trip latency of a request/reply pair of lock_free_queues, for each
+// CPU pairing and with spinning versus yielding waiters.
+void benchmark_ping_pong(int rounds) {
+    std::cout << "\n--- Ping-pong: round-trip latency through two lock_free_queues ---" << std::endl;
+    cpu_topology const topology = cpu_topology::detect();
+    std::cout << rounds << " round trips per run" << std::endl;
+
+    struct pairing {
+        std::string name;
+        placement strategy;
+    };
+    std::vector<pairing> const pairings = {
+        {"unpinned", placement::none},
+        {"same-core", placement::smt_siblings},
+        {"cross-core", placement::same_socket},
+        {"cross-socket", placement::cross_socket},
+    };
+    bool const can_spin = topology.cpus().size() >= 2;
+
+    print_latency_header("pairing / wait");
+    for (const auto& pair : pairings) {
+        placement_plan const plan = plan_placement(topology, pair.strategy, 1, 1);
+        if (!plan.feasible()) {
+            std::cout << pair.name << ": skipped (" << plan.error << ")" << std::endl;
+            continue;
+        }
+        int const a = plan.producer_cpus.empty() ? -1 : plan.producer_cpus.front();
+        int const b = plan.consumer_cpus.empty() ? -1 : plan.consumer_cpus.front();
+        if (pair.strategy != placement::none && a == b) {
+            std::cout << pair.name << ": skipped (needs two distinct CPUs)" << std::endl;
+            continue;
+        }
+        for (wait_mode mode : {wait_mode::busy_spin, wait_mode::yield}) {
+            std::string const name = pair.name + (mode == wait_mode::busy_spin ? " / spin" : " / yield");
+            if (mode == wait_mode::busy_spin && !can_spin) {
+                std::cout << name << ": skipped (spinning needs at least two CPUs)" << std::endl;
+                continue;
+            }
+            print_latency_row(name, run_ping_pong<lock_free_queue<int>>(rounds, rounds / 10, mode, a, b));
+        }
+    }
+}
+
+void print_paced_row(const paced_result& r) {
+    std::cout << std::left << std::setw(22) << r.name << std::right
+              << std::setw(10) << r.items
+              << std::setw(12) << static_cast<long long>(r.achieved_rate)
+              << std::setw(12) << r.empty_pops
+              << std::setw(12) << r.empty_transitions
+              << std::setw(10) << r.latency.p50_ns
+              << std::setw(10) << r.latency.p99_ns
+              << std::setw(12) << r.latency.max_ns
+              << std::setw(8) << (r.verified ? "ok" : "FAILED") << std::endl;
+}
+
+// Feeds lock_free_queue with Poisson, on/off bursty and (optionally) recorded
+// arrivals, so the transitions through an empty queue are exercised instead of
+// a permanently saturated one.
+void benchmark_bursty(const std::string& trace_path) {
+    std::cout << "\n--- Bursty arrivals: lock_free_queue around empty transitions ---" << std::endl;
+    const int num_producers = 2;
+    const int num_consumers = 2;
+    const std::size_t items = 200000;
+
+    std::vector<std::pair<std::string, arrival_schedule>> patterns;
+    patterns.emplace_back("poisson 1M/s", poisson_arrivals(1e6, items, 42));
+    patterns.emplace_back("on/off 512 @ 5M/s", on_off_arrivals(5e6, 512, std::chrono::microseconds(200), items));
+    patterns.emplace_back("on/off 8 @ 5M/s", on_off_arrivals(5e6, 8, std::chrono::microseconds(10), items));
+    if (!trace_path.empty()) {
+        patterns.emplace_back("trace", trace_arrivals(trace_path));
+    }
+
+    std::cout << std::left << std::setw(22) << "pattern" << std::right
+              << std::setw(10) << "items" << std::setw(12) << "items/s"
+              << std::setw(12) << "empty pops" << std::setw(12) << "drained"
+              << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns"
+              << std::setw(12) << "max ns" << std::setw(8) << "check" << std::endl;
+    for (const auto& [name, schedule] : patterns) {
+        print_paced_row(run_paced<lock_free_queue<timed_item>>(
+            name, split_schedule(schedule, num_producers), num_consumers, latency_origin::actual_send));
+    }
+    if (trace_path.empty()) {
+        std::cout << "(pass a file of nanosecond timestamps, one per line, to replay a trace)" << std::endl;
+    }
+}
+
+// Open-loop load sweep: producers push against a fixed schedule of intended
+// send times and latency is charged from those times, so once the queue
+// saturates the growing backlog shows up in the percentiles instead of being
+// hidden by producers that slow down (coordinated omission).
+void benchmark_open_loop(int duration_ms) {
+    std::cout << "\n--- Open loop: latency vs offered load for lock_free_queue ---" << std::endl;
+    const int num_producers = 2;
+    const int num_consumers = 2;
+    std::vector<double> const offered_rates = {1e5, 2.5e5, 5e5, 1e6, 2e6, 4e6, 8e6};
+
+    std::cout << std::left << std::setw(14) << "offered/s" << std::right
+              << std::setw(14) << "achieved/s" << std::setw(12) << "p50 ns"
+              << std::setw(12) << "p99 ns" << std::setw(14) << "p99.9 ns"
+              << std::setw(14) << "max ns" << std::setw(8) << "check" << std::endl;
+    std::uint64_t lowest_load_p99 = 0;
+    bool knee_reported = false;
+    for (double rate : offered_rates) {
+        bool const first = lowest_load_p99 == 0;
+        auto const items = static_cast<std::size_t>(rate * duration_ms / 1000.0);
+        paced_result const r = run_paced<lock_free_queue<timed_item>>(
+            "open loop", split_schedule(constant_rate_arrivals(rate, items), num_producers),
+            num_consumers, latency_origin::intended_send);
+        if (lowest_load_p99 == 0) {
+            lowest_load_p99 = std::max<std::uint64_t>(r.latency.p99_ns, 1);
+        }
+        std::cout << std::left << std::setw(14) << static_cast<long long>(rate) << std::right
+                  << std::setw(14) << static_cast<long long>(r.achieved_rate)
+                  << std::setw(12) << r.latency.p50_ns << std::setw(12) << r.latency.p99_ns
+                  << std::setw(14) << r.latency.p999_ns << std::setw(14) << r.latency.max_ns
+                  << std::setw(8) << (r.verified ? "ok" : "FAILED");
+        // The knee: throughput stops tracking the offered load or the tail
+        // blows up relative to the lightest load.
+        if (!first && !knee_reported &&
+            (r.achieved_rate < 0.9 * rate || r.latency.p99_ns > 10 * lowest_load_p99)) {
+            std::cout << "  <- knee";
+            knee_reported = true;
+        }
+        std::cout << std::endl;
+    }
+}
+
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+// Pushes bursts into a queue, lets them sit, and shows the per-item sojourn
+// times reported by pop() and the queue's own histogram.
+void test_sojourn_time() {
+    std::cout << "\n--- Sojourn time: how long items wait in lock_free_queue ---" << std::endl;
+    lock_free_queue<int> queue;
+    const int bursts = 20;
+    const int burst_size = 1000;
+    double max_first_ns = 0;
+    for (int b = 0; b < bursts; ++b) {
+        for (int i = 0; i < burst_size; ++i) {
+            queue.push(i);
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        for (int i = 0; i < burst_size; ++i) {
+            std::uint64_t sojourn = 0;
+            auto value = queue.pop(sojourn);
+            assert(value && *value == i);
+            if (i == 0) {
+                max_first_ns = std::max(max_first_ns, cycles_to_ns(sojourn));
+            }
+        }
+    }
+    const log2_histogram& histogram = queue.sojourn_histogram();
+    assert(histogram.total() == bursts * burst_size);
+    std::cout << "Items popped: " << histogram.total() << std::endl;
+    std::cout << "p50 sojourn <= " << cycles_to_ns(histogram.quantile_upper_bound(0.5)) << " ns" << std::endl;
+    std::cout << "p99 sojourn <= " << cycles_to_ns(histogram.quantile_upper_bound(0.99)) << " ns" << std::endl;
+    std::cout << "Largest head-of-burst sojourn: " << max_first_ns << " ns (each burst slept 200000 ns)" << std::endl;
+    assert(max_first_ns >= 200000);
+}
+#endif
+
+#ifdef LOCK_FREE_QUEUE_TRACING
+// Runs a short MPMC burst with tracing compiled in and writes the per-thread
+// rings as Chrome trace JSON for Perfetto / chrome://tracing.
+void dump_trace(const std::string& path) {
+    std::cout << "\n--- Trace: recording lock_free_queue events ---" << std::endl;
+    mpmc_workload workload;
+    workload.num_producers = 2;
+    workload.num_consumers = 2;
+    workload.items_per_producer = 5000;
+    throughput_result const r = run_mpmc_throughput<lock_free_queue<int>>("traced", workload);
+    assert(r.verified);
+    std::ofstream out(path);
+    std::size_t const events = write_chrome_trace(out);
+    std::cout << "Wrote " << events << " events to " << path << std::endl;
+
+    // Pushes rejected by close() and pops of a closed queue must still end
+    // the slices they began.
+    trace_registry::instance().clear();
+    lock_free_queue<int> queue;
+    queue.push(1);
+    queue.close();
+    for (int i = 0; i < 3; ++i) {
+        queue.push(i);
+    }
+    int value = 0;
+    while (queue.nonblocking_pop(value) == queue_op_status::success) {
+    }
+    for (const auto& ring : trace_registry::instance().all_rings()) {
+        int depth = 0;
+        for (const trace_record& r : ring->snapshot()) {
+            switch (r.event) {
+                case trace_event::push_begin:
+                case trace_event::pop_begin: ++depth; break;
+                case trace_event::push_end:
+                case trace_event::pop_end:
+                case trace_event::pop_empty: --depth; break;
+                default: break;
+            }
+            if (depth < 0 || depth > 1) {
+                throw std::runtime_error("unbalanced push/pop trace slices");
+            }
+        }
+        if (depth != 0) {
+            throw std::runtime_error("push/pop trace slice left open");
+        }
+    }
+    std::cout << "✓ begin/end slices balanced across close()" << std::endl;
+}
+#endif
+
+// Large payload with a non-trivial move, counting how it gets constructed.
+struct counting_payload {
+    static inline long long constructions = 0;
+    static inline long long copies = 0;
+    static inline long long moves = 0;
+
+    std::array<std::uint64_t, 32> words{};
+    std::string tag;
+
+    counting_payload() { ++constructions; }
+    explicit counting_payload(std::uint64_t id) : tag("payload") {
+        words[0] = id;
+        ++constructions;
+    }
+    counting_payload(const counting_payload& other) : words(other.words), tag(other.tag) { ++copies; }
+    counting_payload(counting_payload&& other) noexcept : words(other.words), tag(std::move(other.tag)) { ++moves; }
+    counting_payload& operator=(const counting_payload& other) {
+        words = other.words;
+        tag = other.tag;
+        ++copies;
+        return *this;
+    }
+    counting_payload& operator=(counting_payload&& other) noexcept {
+        words = other.words;
+        tag = std::move(other.tag);
+        ++moves;
+        return *this;
+    }
+
+    static void reset() { constructions = copies = moves = 0; }
+};
+
+// Counts constructions, copies and moves per operation for each way of getting
+// a large payload into and out of lock_free_queue.
+void benchmark_payload_paths(int items) {
+    std::cout << "\n--- Payload paths: constructions per op on a large payload ---" << std::endl;
+    std::cout << std::left << std::setw(34) << "operation" << std::right
+              << std::setw(10) << "ctor/op" << std::setw(10) << "copy/op"
+              << std::setw(10) << "move/op" << std::setw(10) << "ns/op" << std::endl;
+    auto report = [items](const std::string& name, auto&& body) {
+        counting_payload::reset();
+        auto const start = std::chrono::steady_clock::now();
+        body();
+        double const ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::cout << std::left << std::setw(34) << name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << double(counting_payload::constructions) / items
+                  << std::setw(10) << double(counting_payload::copies) / items
+                  << std::setw(10) << double(counting_payload::moves) / items
+                  << std::setprecision(0) << std::setw(10) << ns / items << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    };
+
+    counting_payload const source(7);
+    lock_free_queue<counting_payload> queue;
+    report("by-value push (previous API)", [&] {
+        for (int i = 0; i < items; ++i) {
+            counting_payload by_value(source);
+            queue.push(std::move(by_value));
+        }
+    });
+    report("pop() -> unique_ptr, move out", [&] {
+        for (int i = 0; i < items; ++i) {
+            counting_payload out(std::move(*queue.pop()));
+        }
+    });
+    report("push(const T&)", [&] {
+        for (int i = 0; i < items; ++i) {
+            queue.push(source);
+        }
+    });
+    report("try_pop(T&)", [&] {
+        counting_payload out;
+        counting_payload::reset();
+        for (int i = 0; i < items; ++i) {
+            bool const ok = queue.try_pop(out);
+            assert(ok);
+            (void)ok;
+        }
+    });
+    report("emplace(args...)", [&] {
+        for (int i = 0; i < items; ++i) {
+            queue.emplace(static_cast<std::uint64_t>(i));
+        }
+    });
+    report("try_pop() -> std::optional", [&] {
+        for (int i = 0; i < items; ++i) {
+            std::optional<counting_payload> out = queue.try_pop();
+            assert(out && out->words[0] == static_cast<std::uint64_t>(i));
+        }
+    });
+    assert(!queue.try_pop());
+}
+
+// Fills one queue to full depth and drains it again on a single thread, where
+// node addresses rather than contention decide the cost. Compares plain
+// new/delete nodes against pooled nodes on 64 KiB chunks and on 2 MiB huge
+// pages, counting data TLB misses where perf events are available.
+template <typename Queue>
+void deep_queue_row(const std::string& name, int items) {
+    Queue queue;
+    perf_counter dtlb = perf_counter::dtlb_read_misses();
+    dtlb.start();
+    auto const start = std::chrono::steady_clock::now();
+    for (int i = 0; i < items; ++i) {
+        queue.push(i);
+    }
+    auto const filled = std::chrono::steady_clock::now();
+    int value = 0;
+    for (int i = 0; i < items; ++i) {
+        bool const ok = queue.try_pop(value);
+        assert(ok && value == i);
+        (void)ok;
+    }
+    auto const drained = std::chrono::steady_clock::now();
+    dtlb.stop();
+
+    double const fill_ms = std::chrono::duration<double, std::milli>(filled - start).count();
+    double const drain_ms = std::chrono::duration<double, std::milli>(drained - filled).count();
+    std::optional<std::uint64_t> const misses = dtlb.read();
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << fill_ms << std::setw(10) << drain_ms
+              << std::setw(10) << 2.0 * items / (fill_ms + drain_ms) / 1000.0
+              << std::setw(16) << (misses ? std::to_string(*misses) : "n/a") << std::endl;
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+void benchmark_deep_queue(int items) {
+    std::cout << "\n--- Deep queue: " << items << " items pushed, then popped, one thread ---" << std::endl;
+    std::cout << std::left << std::setw(28) << "allocator" << std::right
+              << std::setw(10) << "fill ms" << std::setw(10) << "drain ms"
+              << std::setw(10) << "Mops/s" << std::setw(16) << "dTLB misses" << std::endl;
+    deep_queue_row<lock_free_queue<int>>("new/delete", items);
+    deep_queue_row<lock_free_queue<int, fixed_block_allocator<int>>>("pool, 64 KiB chunks", items);
+    deep_queue_row<lock_free_queue<int, huge_page_allocator<int>>>("pool, 2 MiB huge pages", items);
+    std::cout << "huge page chunks: " << huge_page_chunk_source::huge_chunks().load()
+              << " advised, " << huge_page_chunk_source::fallback_chunks().load()
+              << " on normal pages" << std::endl;
+}
+
+// A traffic spike leaves the node pool holding its peak; trim() hands the
+// fully free chunks back. Then a background trimmer runs against live MPMC
+// traffic to check trimming never disturbs concurrent pushes and pops.
+void benchmark_trim(int items) {
+    using pooled_queue = lock_free_queue<int, fixed_block_allocator<int>>;
+    std::cout << "\n--- Trim: pooled node memory after a " << items << " item spike ---" << std::endl;
+    std::cout << std::left << std::setw(24) << "stage" << std::right << std::setw(12) << "RSS KiB"
+              << std::setw(14) << "pooled nodes" << std::setw(14) << "retained KiB"
+              << std::setw(14) << "released KiB" << std::endl;
+    pooled_queue queue;
+    auto row = [&queue](const std::string& stage) {
+        queue_memory_usage const usage = queue.memory_usage();
+        std::cout << std::left << std::setw(24) << stage << std::right
+                  << std::setw(12) << resident_set_bytes() / 1024
+                  << std::setw(14) << usage.pooled_nodes
+                  << std::setw(14) << usage.retained_bytes / 1024
+                  << std::setw(14) << usage.released_bytes / 1024 << std::endl;
+    };
+    row("start");
+    for (int i = 0; i < items; ++i) {
+        queue.push(i);
+    }
+    row("spike queued");
+    int value = 0;
+    while (queue.try_pop(value)) {
+    }
+    row("drained");
+    std::size_t const released = queue.trim(1 << 20);
+    row("trim(1 MiB)");
+    for (int i = 0; i < items / 2; ++i) {
+        queue.push(i);
+    }
+    row("half spike again");
+    while (queue.try_pop(value)) {
+    }
+    std::cout << "trim released " << released / 1024 << " KiB" << std::endl;
+
+    mpmc_workload workload;
+    workload.items_per_producer = std::max(items / 4, 1000);
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<pooled_queue>("pool, no trimming", workload));
+    auto carved_bytes = [&queue] {
+        queue_memory_usage const usage = queue.memory_usage();
+        return usage.retained_bytes + usage.released_bytes;
+    };
+    std::size_t const carved_before = carved_bytes();
+    {
+        background_trimmer trimmer([&queue] { return queue.trim(0); }, std::chrono::milliseconds(1));
+        results.push_back(run_mpmc_throughput<pooled_queue>("pool, trim(0) every 1ms", workload));
+        std::cout << "background trimmer: " << trimmer.trim_passes() << " passes, "
+                  << trimmer.released_bytes() / 1024 << " KiB released, pool grew by "
+                  << (carved_bytes() - carved_before) / 1024 << " KiB" << std::endl;
+    }
+    print_throughput_table(results);
+}
+
+// Far more threads than CPUs, so threads are preempted mid-operation while
+// holding node references and hundreds of them retry on the same head and
+// tail. Every run is verified for lost, duplicated and reordered items.
+void stress_many_threads(int threads, int items_per_producer) {
+    std::cout << "\n--- Stress: " << threads << " producers and " << threads
+              << " consumers ---" << std::endl;
+    mpmc_workload workload;
+    workload.num_producers = threads;
+    workload.num_consumers = threads;
+    workload.items_per_producer = items_per_producer;
+    std::vector<throughput_result> results;
+    results.push_back(run_mpmc_throughput<lock_free_queue<int>>("lock_free_queue", workload));
+    // long double is too large to store inline, so this row covers boxed values.
+    results.push_back(run_mpmc_throughput<lock_free_queue<long double>>("lfq, boxed values", workload));
+    results.push_back(run_mpmc_throughput<lock_free_queue<int, fixed_block_allocator<int>>>(
+        "lock_free_queue+pool", workload));
+    print_throughput_table(results);
+    for (const auto& r : results) {
+        if (!r.verified) {
+            throw std::runtime_error(r.name + " lost, duplicated or reordered items");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::cout << "Testing Lock-Free Queue Implementation" << std::endl;
     std::cout << "Hardware concurrency: " << std::thread::hardware_concurrency() << " threads" << std::endl;
 
+    std::string const mode = argc > 1 ? argv[1] : "test";
     try {
-        test_multiple_producers_consumers();
-        std::cout << "\n MPMC test passed successfully!" << std::endl;
-
+        if (mode == "test") {
+            test_multiple_producers_consumers();
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+            test_memory_usage(100000);
+#endif
+            test_counter_wraparound();
+            test_close();
+            test_spread_placement();
+            std::cout << "\n MPMC test passed successfully!" << std::endl;
+        } else if (mode == "compare") {
+            benchmark_queue_comparison(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "placement") {
+            benchmark_placement(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "pingpong") {
+            benchmark_ping_pong(argc > 2 ? std::stoi(argv[2]) : 100000);
+        } else if (mode == "payload") {
+            benchmark_payload_paths(argc > 2 ? std::stoi(argv[2]) : 200000);
+        } else if (mode == "numa") {
+            benchmark_numa(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "priority") {
+            benchmark_priority(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "lanes") {
+            benchmark_lanes(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "delay") {
+            benchmark_delay_queue(argc > 2 ? std::stoi(argv[2]) : 2000000);
+        } else if (mode == "fanout") {
+            benchmark_fanout(argc > 2 ? std::stoi(argv[2]) : 1000000);
+        } else if (mode == "intrusive") {
+            benchmark_intrusive(argc > 2 ? std::stoi(argv[2]) : 250000);
+        } else if (mode == "bytes") {
+            benchmark_byte_messages(argc > 2 ? std::stoi(argv[2]) : 250000);
+#if defined(__unix__) || defined(__APPLE__)
+        } else if (mode == "shm") {
+            benchmark_shm(argc > 2 ? std::stoi(argv[2]) : 1000000);
+        } else if (mode == "spill") {
+            benchmark_spill(argc > 2 ? std::stoi(argv[2]) : 2000000);
+#endif
+        } else if (mode == "select") {
+            benchmark_select(argc > 2 ? std::stoi(argv[2]) : 200000);
+        } else if (mode == "stress") {
+            stress_many_threads(argc > 2 ? std::stoi(argv[2]) : 256, argc > 3 ? std::stoi(argv[3]) : 2000);
+        } else if (mode == "trim") {
+            benchmark_trim(argc > 2 ? std::stoi(argv[2]) : 2000000);
+        } else if (mode == "deep") {
+            benchmark_deep_queue(argc > 2 ? std::stoi(argv[2]) : 10000000);
+        } else if (mode == "bursty") {
+            benchmark_bursty(argc > 2 ? argv[2] : "");
+        } else if (mode == "openloop") {
+            benchmark_open_loop(argc > 2 ? std::stoi(argv[2]) : 200);
+#ifdef LOCK_FREE_QUEUE_TRACING
+        } else if (mode == "trace") {
+            dump_trace(argc > 2 ? argv[2] : "lock_free_queue_trace.json");
+#endif
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+        } else if (mode == "sojourn") {
+            test_sojourn_time();
+#endif
+        } else {
+            std::cerr << "Unknown mode '" << mode << "'. Modes: test, compare [items_per_producer], "
+                      << "placement [items_per_producer], pingpong [rounds], "
+                      << "bursty [trace_file], openloop [duration_ms], payload [items], "
+                      << "deep [items], numa [items_per_producer], trim [items], "
+                      << "stress [threads] [items_per_producer], priority [items_per_producer], "
+                      << "lanes [items_per_producer], delay [timers], fanout [messages], "
+                      << "intrusive [items_per_producer], bytes [messages_per_producer], shm [messages], "
+                      << "spill [items], select [items]" << std::endl;
+            return 1;
+        }
     } catch (const std::exception& e) {
         std::cerr << "Test failed with exception: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,213 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef NUMA_ALLOCATOR_H
+#define NUMA_ALLOCATOR_H
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#include "block_allocator.h"
+#include "topology.h"
+
+// NUMA node of the CPU the calling thread is running on right now, or 0 where
+// getcpu is unavailable.
+inline int current_numa_node() {
+#ifdef __linux__
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (getcpu(&cpu, &node) == 0) {
+        return static_cast<int>(node);
+    }
+#endif
+    return 0;
+}
+
+// One block_pool per NUMA node (nodes taken from /sys topology). Threads
+// allocate from the pool of the node they run on. A block freed on another node
+// is parked in a per-thread batch for its owner and handed back with a single
+// push once the batch fills or the thread exits, so a cross-socket consumer
+// touches the remote free list once per batch instead of once per node.
+//
+// Chunks come from fresh mappings and are carved by the allocating thread, so
+// under the default first-touch policy their pages land on that thread's node.
+template <std::size_t BlockSize, std::size_t Alignment, typename ChunkSource = huge_page_chunk_source>
+class numa_block_pool {
+private:
+    using pool = block_pool<BlockSize, Alignment, ChunkSource>;
+    static constexpr std::size_t batch_size = 64;
+    // Nodes with a higher id are freed straight into their pool, unbatched.
+    static constexpr std::size_t max_batched_nodes = 8;
+
+    std::vector<std::unique_ptr<pool>> pools;
+
+    struct remote_batch {
+        pool* owner = nullptr;
+        std::size_t count = 0;
+        std::array<void*, batch_size> blocks{};
+
+        void flush() {
+            if (count != 0) {
+                owner->deallocate_batch(blocks.data(), count);
+                count = 0;
+            }
+        }
+    };
+
+    // Fixed size, so parking a block never allocates: deallocate() runs from
+    // destructors and other noexcept paths.
+    struct thread_batches {
+        std::array<remote_batch, max_batched_nodes> batches;
+
+        ~thread_batches() { flush(); }
+
+        void flush() {
+            for (auto& batch : batches) {
+                batch.flush();
+            }
+        }
+    };
+
+    static thread_batches& local_batches() {
+        thread_local thread_batches batches;
+        return batches;
+    }
+
+    std::size_t node_of(const pool* owner) const {
+        for (std::size_t node = 0; node < pools.size(); ++node) {
+            if (pools[node].get() == owner) {
+                return node;
+            }
+        }
+        return pools.size();
+    }
+
+    pool& local_pool() {
+        auto const node = static_cast<std::size_t>(current_numa_node());
+        return *pools[node < pools.size() ? node : 0];
+    }
+
+public:
+    numa_block_pool() {
+        std::vector<int> const nodes = cpu_topology::detect().numa_nodes();
+        pools.resize(nodes.empty() ? 1 : static_cast<std::size_t>(nodes.back()) + 1);
+        for (auto& p : pools) {
+            p = std::make_unique<pool>();
+        }
+    }
+
+    numa_block_pool(const numa_block_pool&) = delete;
+    numa_block_pool& operator=(const numa_block_pool&) = delete;
+
+    std::size_t node_count() const { return pools.size(); }
+
+    void* allocate() { return local_pool().allocate(); }
+
+    void deallocate(void* p) {
+        pool* const owner = pool::owner_of(p);
+        if (owner == &local_pool()) {
+            owner->deallocate(p);
+            return;
+        }
+        std::size_t const node = node_of(owner);
+        if (node >= pools.size() || node >= max_batched_nodes) {
+            owner->deallocate(p);
+            return;
+        }
+        remote_batch& batch = local_batches().batches[node];
+        if (batch.owner != owner) {
+            // The slot belongs to another numa_block_pool of the same shape.
+            batch.flush();
+            batch.owner = owner;
+        }
+        batch.blocks[batch.count++] = p;
+        if (batch.count == batch_size) {
+            batch.flush();
+        }
+    }
+
+    // Summed over the per-node pools. Blocks parked in remote batches count
+    // as in use until they are handed back: up to batch_size - 1 per node per
+    // thread, until that thread exits or calls flush_thread_batches().
+    block_pool_stats stats() {
+        block_pool_stats total;
+        for (auto& p : pools) {
+            block_pool_stats const s = p->stats();
+            total.block_size = s.block_size;
+            total.total_blocks += s.total_blocks;
+            total.free_blocks += s.free_blocks;
+            total.retained_bytes += s.retained_bytes;
+            total.released_bytes += s.released_bytes;
+        }
+        return total;
+    }
+
+    // Splits the watermark evenly across the node pools. Flushes the calling
+    // thread's parked blocks first; other threads' stay parked and keep their
+    // chunks from being released.
+    std::size_t trim(std::size_t max_retained) {
+        flush_thread_batches();
+        std::size_t released = 0;
+        for (auto& p : pools) {
+            released += p->trim(max_retained / pools.size());
+        }
+        return released;
+    }
+
+    // Hands back the calling thread's parked remote blocks now.
+    void flush_thread_batches() { local_batches().flush(); }
+
+    // Never destroyed, for the same reason as block_pool::instance().
+    static numa_block_pool& instance() {
+        static numa_block_pool* const shared = new numa_block_pool;
+        return *shared;
+    }
+};
+
+// fixed_block_allocator counterpart backed by numa_block_pool.
+template <typename T>
+class numa_allocator {
+private:
+    using pool = numa_block_pool<sizeof(T), alignof(T)>;
+
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = numa_allocator<U>;
+    };
+
+    numa_allocator() noexcept = default;
+
+    template <typename U>
+    numa_allocator(const numa_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (n == 1) {
+            return static_cast<T*>(pool::instance().allocate());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if (n == 1) {
+            pool::instance().deallocate(p);
+            return;
+        }
+        ::operator delete(p, std::align_val_t(alignof(T)));
+    }
+
+    static block_pool_stats pool_stats() { return pool::instance().stats(); }
+
+    static std::size_t trim(std::size_t max_retained) { return pool::instance().trim(max_retained); }
+
+    template <typename U>
+    bool operator==(const numa_allocator<U>&) const noexcept { return true; }
+};
+
+#endif //NUMA_ALLOCATOR_H
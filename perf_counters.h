@@ -0,0 +1,125 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// One hardware event counted for the calling thread through perf_event_open,
+// optionally including threads it starts while the counter is enabled (their
+// counts are folded in when they exit). Opening fails in containers, under a
+// strict perf_event_paranoid, or off Linux; the counter then stays invalid and
+// read() returns nothing.
+class perf_counter {
+private:
+    int fd = -1;
+
+public:
+    perf_counter(std::uint32_t type, std::uint64_t config, bool inherit = false) {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = inherit ? 1 : 0;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)type;
+        (void)config;
+        (void)inherit;
+#endif
+    }
+
+    perf_counter(const perf_counter&) = delete;
+    perf_counter& operator=(const perf_counter&) = delete;
+
+    ~perf_counter() {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    bool valid() const { return fd >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+
+    std::optional<std::uint64_t> read() const {
+#ifdef __linux__
+        std::uint64_t value = 0;
+        if (fd >= 0 && ::read(fd, &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value))) {
+            return value;
+        }
+#endif
+        return std::nullopt;
+    }
+
+    // Data TLB load misses.
+    static perf_counter dtlb_read_misses() {
+#ifdef __linux__
+        return perf_counter(PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_DTLB |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+        return perf_counter(0, 0);
+#endif
+    }
+
+    // Loads served from another NUMA node's memory.
+    static perf_counter remote_node_reads(bool inherit) {
+#ifdef __linux__
+        return perf_counter(PERF_TYPE_HW_CACHE,
+                            PERF_COUNT_HW_CACHE_NODE |
+                            (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                            inherit);
+#else
+        return perf_counter(0, 0, inherit);
+#endif
+    }
+};
+
+// Resident set size of this process, or 0 where /proc is unavailable.
+inline std::size_t resident_set_bytes() {
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    std::size_t total_pages = 0;
+    std::size_t resident_pages = 0;
+    if (statm >> total_pages >> resident_pages) {
+        return resident_pages * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+#endif //PERF_COUNTERS_H
@@ -0,0 +1,148 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef PRIORITY_LANES_QUEUE_H
+#define PRIORITY_LANES_QUEUE_H
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "queue.h"
+
+// N lock_free_queue lanes, lane 0 the most urgent, plus a bitmask of lanes
+// that may hold items, so a pop finds the most urgent non-empty lane with one
+// load and countr_zero instead of polling every lane.
+//
+// A pusher sets its lane's bit after pushing; a popper that finds a lane empty
+// clears the bit and then looks again, restoring the bit if it finds an item
+// after all. Both sides are sequentially consistent, so an item is never left
+// behind a clear bit.
+//
+// By default pops are strictly by lane. Constructed with weights, the queue's
+// pops, from whichever consumer, follow a smooth weighted round-robin schedule
+// over the lanes: in every sum(weights) pops a non-empty lane i gets at least
+// weights[i] of them, which bounds how long a busy urgent lane can starve the
+// rest. A lane whose turn comes while it is empty passes the pop to the most
+// urgent non-empty lane.
+template <typename T, std::size_t N, typename Allocator = std::allocator<T>>
+class priority_lanes_queue {
+private:
+    static_assert(N >= 1 && N <= 64, "the non-empty mask is a single 64-bit word");
+
+    std::array<lock_free_queue<T, Allocator>, N> lanes;
+    alignas(64) std::atomic<std::uint64_t> non_empty{0};
+    std::vector<std::uint8_t> schedule;
+    // Pops taken through the schedule so far; only used with weights.
+    alignas(64) std::atomic<std::size_t> turn{0};
+
+    static std::uint64_t bit(std::size_t lane) { return std::uint64_t(1) << lane; }
+
+    void mark_non_empty(std::size_t lane) {
+        // Plain load first: the bit is usually already set and a read keeps
+        // the line shared between pushers.
+        if (!(non_empty.load() & bit(lane))) {
+            non_empty.fetch_or(bit(lane));
+        }
+    }
+
+    bool pop_lane(std::size_t lane, T& out) {
+        if (lanes[lane].try_pop(out)) {
+            return true;
+        }
+        non_empty.fetch_and(~bit(lane));
+        if (lanes[lane].try_pop(out)) {
+            mark_non_empty(lane);
+            return true;
+        }
+        return false;
+    }
+
+    std::size_t next_turn() {
+        return schedule[turn.fetch_add(1, std::memory_order_relaxed) % schedule.size()];
+    }
+
+public:
+    priority_lanes_queue() = default;
+
+    // weights[i] > 0 is lane i's share of pops while it has items; e.g.
+    // {8, 4, 2, 1} gives the last lane at least 1 pop in 15.
+    explicit priority_lanes_queue(const std::array<unsigned, N>& weights) {
+        // Smooth weighted round robin: spreads each lane's turns evenly
+        // through the cycle instead of in runs.
+        std::array<long long, N> current{};
+        long long total = 0;
+        for (unsigned w : weights) {
+            total += w;
+        }
+        for (long long i = 0; i < total; ++i) {
+            std::size_t best = 0;
+            for (std::size_t lane = 0; lane < N; ++lane) {
+                current[lane] += weights[lane];
+                if (current[lane] > current[best]) {
+                    best = lane;
+                }
+            }
+            current[best] -= total;
+            schedule.push_back(static_cast<std::uint8_t>(best));
+        }
+    }
+
+    priority_lanes_queue(const priority_lanes_queue&) = delete;
+    priority_lanes_queue& operator=(const priority_lanes_queue&) = delete;
+
+    template <typename U>
+    void push(std::size_t lane, U&& value) {
+        lanes[lane].push(std::forward<U>(value));
+        mark_non_empty(lane);
+    }
+
+    template <typename... Args>
+    void emplace(std::size_t lane, Args&&... args) {
+        lanes[lane].emplace(std::forward<Args>(args)...);
+        mark_non_empty(lane);
+    }
+
+    // Pops from the lane whose turn it is, or else the most urgent non-empty
+    // one, and reports which lane served it. False if every lane was empty.
+    bool try_pop(T& out, std::size_t& lane) {
+        if (!schedule.empty()) {
+            std::size_t const turn = next_turn();
+            if ((non_empty.load() & bit(turn)) && pop_lane(turn, out)) {
+                lane = turn;
+                return true;
+            }
+        }
+        for (std::uint64_t mask = non_empty.load(); mask; mask = non_empty.load()) {
+            auto const first = static_cast<std::size_t>(std::countr_zero(mask));
+            if (pop_lane(first, out)) {
+                lane = first;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool try_pop(T& out) {
+        std::size_t lane;
+        return try_pop(out, lane);
+    }
+
+    std::optional<T> try_pop() {
+        T out;
+        if (!try_pop(out)) {
+            return std::nullopt;
+        }
+        return out;
+    }
+
+    // Lanes that may currently hold items, lane i in bit i.
+    std::uint64_t non_empty_mask() const { return non_empty.load(std::memory_order_relaxed); }
+};
+
+#endif //PRIORITY_LANES_QUEUE_H
@@ -4,142 +4,635 @@
 
 #ifndef QUEUE_H
 #define QUEUE_H
+#include <algorithm>
 #include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "event_count.h"
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+#include "sharded_counter.h"
+#endif
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+#include "cycle_clock.h"
+#include "histogram.h"
+#endif
+#ifdef LOCK_FREE_QUEUE_TRACING
+#include "trace.h"
+#else
+#define LFQ_TRACE(event, arg) ((void)0)
+#endif
 
-template <typename T>
+// Snapshot returned by lock_free_queue::memory_usage(). live_nodes and
+// live_values are this queue's own counts in LOCK_FREE_QUEUE_MEMORY_STATS
+// builds; otherwise live_nodes is the node pool's blocks in use (shared by
+// every queue drawing from it) when there is a pool, and both are 0 without.
+// What queue_memory_usage::live_nodes and live_values count.
+enum class memory_count_scope {
+    unavailable,  // not counted; build with LOCK_FREE_QUEUE_MEMORY_STATS
+    per_queue,    // this queue's own nodes and values
+    pool_wide,    // live_nodes covers every queue sharing the node pool; values are not counted
+};
+
+struct queue_memory_usage {
+    memory_count_scope live_counts = memory_count_scope::unavailable;
+    std::size_t node_size = 0;     // bytes per node
+    std::size_t live_nodes = 0;    // allocated nodes, including the dummy
+    std::size_t live_values = 0;   // values allocated outside their node
+    std::size_t value_size = 0;
+    std::size_t pooled_nodes = 0;  // free node blocks held by the allocator's pool
+    std::size_t pooled_bytes = 0;  // (shared by every queue drawing from it)
+    std::size_t retained_bytes = 0;  // pool memory still backed, in use or not
+    std::size_t released_bytes = 0;  // pool memory handed back to the OS by trim()
+
+    std::size_t live_bytes() const { return live_nodes * node_size + live_values * value_size; }
+    std::size_t total_bytes() const { return live_bytes() + pooled_bytes; }
+};
+
+class queue_set;
+
+// Outcome of a pop that can tell an empty queue from a closed one.
+enum class queue_op_status {
+    success,
+    empty,   // nothing queued right now
+    closed,  // closed and drained: nothing will ever be queued again
+};
+
+// Allocator is used for both the queue's nodes and the values it holds; it is
+// rebound to each with std::allocator_traits, so any standard-conforming
+// allocator (or fixed_block_allocator from block_allocator.h) works.
+//
+// Small trivially copyable values (up to pointer size) are stored inside the
+// node itself; anything else lives in its own allocation.
+//
+// close() claims the tail node without storing a value, so it stays the tail
+// for good: later pushes fail to claim it and see why, and pops that find it
+// at the front report closed. Neither check adds work while the queue is open.
+template <typename T, typename Allocator = std::allocator<T>>
 class lock_free_queue {
 private:
     struct node;
+
+    // Reference counts are modular. The external count in a counted_node_ptr
+    // grows on every access through that pointer (an idle consumer polling an
+    // empty queue keeps bumping head's) and is folded into the node's internal
+    // count when the pointer is retired; both wrap at 2^count_bits. The sum is
+    // exact as long as fewer than 2^count_bits references to one node are held
+    // at once, and each thread holds at most one, so the bound is on
+    // concurrent threads, not on operations. Debug builds check it.
+    static_assert(sizeof(void*) == 8, "counted_node_ptr packs a count into 64-bit pointers");
+    static constexpr int address_bits = 48;
+    static constexpr int alignment_bits = 3;
+    static constexpr int pointer_field_bits = address_bits - alignment_bits;
+    static constexpr int count_bits = 64 - pointer_field_bits;
+    static constexpr std::uint64_t pointer_field_mask = (std::uint64_t(1) << pointer_field_bits) - 1;
+    static constexpr std::uint32_t count_mask = (std::uint32_t(1) << count_bits) - 1;
+
+public:
+    // More threads than this operating on one queue at once could alias
+    // reference counts.
+    static constexpr std::size_t max_concurrent_threads = count_mask;
+
+private:
+    // 48-bit node address with its three always-zero low bits dropped, and the
+    // external count in the remaining 19 bits, so head, tail and next are
+    // single 8-byte words.
     struct counted_node_ptr {
-        int external_count;
-        node *ptr;
+        std::uint64_t bits;
+
+        static counted_node_ptr make(node* p, std::uint32_t external_count) {
+            auto const address = reinterpret_cast<std::uintptr_t>(p);
+            assert((address >> address_bits) == 0 && "node address wider than 48 bits");
+            assert((address & ((1u << alignment_bits) - 1)) == 0 && "node not 8-byte aligned");
+            return {(std::uint64_t(external_count & count_mask) << pointer_field_bits) |
+                    (address >> alignment_bits)};
+        }
+
+        node* ptr() const { return reinterpret_cast<node*>((bits & pointer_field_mask) << alignment_bits); }
+        std::uint32_t external_count() const { return static_cast<std::uint32_t>(bits >> pointer_field_bits); }
     };
+
     std::atomic<counted_node_ptr> head;
     std::atomic<counted_node_ptr> tail;
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+    log2_histogram sojourn_cycles;
+#endif
 
+    // internal_count has the same width as the external count it absorbs and
+    // is only updated modulo 2^count_bits. external_count counts the pointers
+    // (head or tail, and the predecessor's next) still referring to the node.
+    // claimed is set by the pusher that stores a value in the node and is
+    // never cleared. closed is set along with it by close() instead.
     struct node_counter {
-        unsigned int internal_count:30;
-        unsigned int external_count:2;
+        std::uint32_t internal_count:count_bits;
+        std::uint32_t external_count:2;
+        std::uint32_t claimed:1;
+        std::uint32_t closed:1;
     };
 
+    static constexpr bool inline_value = std::is_trivially_copyable_v<T> &&
+                                         sizeof(T) <= sizeof(T*) && alignof(T) <= alignof(T*);
+    using stored_type = std::conditional_t<inline_value, T, T*>;
+
     struct node {
-        std::atomic<T*> data;
         std::atomic<node_counter> count;
+        // The value itself, or a pointer to it. Written by the pusher that
+        // claimed the node, before tail moves on.
+        alignas(stored_type) unsigned char payload[sizeof(stored_type)];
         counted_node_ptr next;
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+        std::uint64_t enqueue_cycles;
+#endif
 
         node() {
             node_counter new_count;
             new_count.internal_count = 0;
             new_count.external_count = 2;
+            new_count.claimed = 0;
+            new_count.closed = 0;
             count.store(new_count);
-            next.ptr = nullptr;
-            next.external_count = 0;
-            data.store(nullptr);
+            next = counted_node_ptr::make(nullptr, 0);
         }
 
-        void release_ref() {
+        // A consumed node stays claimed, so a pusher still holding it as a
+        // stale tail cannot store into it again.
+        bool claim() {
             node_counter old_counter = count.load(std::memory_order_relaxed);
-            node_counter new_counter;
-            do {
-                new_counter = old_counter;
-                --new_counter.internal_count;
+            while (!old_counter.claimed) {
+                node_counter new_counter = old_counter;
+                new_counter.claimed = 1;
+                if (count.compare_exchange_weak(old_counter, new_counter)) {
+                    return true;
+                }
             }
-            while (!count.compare_exchange_strong(old_counter, new_counter,
-                                                  std::memory_order_acquire,
-                                                  std::memory_order_relaxed));
-            if (!new_counter.internal_count && !new_counter.external_count) {
-                delete this;
+            return false;
+        }
+
+        // Claims the node for no value, which closes the queue. False if a
+        // pusher claimed it first; true if it is closed, by us or earlier.
+        bool claim_closed() {
+            node_counter old_counter = count.load(std::memory_order_relaxed);
+            while (!old_counter.claimed) {
+                node_counter new_counter = old_counter;
+                new_counter.claimed = 1;
+                new_counter.closed = 1;
+                if (count.compare_exchange_weak(old_counter, new_counter)) {
+                    return true;
+                }
             }
+            return old_counter.closed;
+        }
+
+        bool is_closed() const { return count.load().closed; }
+
+        stored_type& stored() { return *std::launder(reinterpret_cast<stored_type*>(payload)); }
+    };
+    static_assert(alignof(node) >= (1u << alignment_bits));
+
+    using allocator_traits = std::allocator_traits<Allocator>;
+    using value_allocator_type = typename allocator_traits::template rebind_alloc<T>;
+    using value_traits = std::allocator_traits<value_allocator_type>;
+    using node_allocator_type = typename allocator_traits::template rebind_alloc<node>;
+    using node_traits = std::allocator_traits<node_allocator_type>;
+    static constexpr bool default_allocator = std::is_same_v<value_allocator_type, std::allocator<T>>;
+
+    [[no_unique_address]] value_allocator_type value_allocator;
+    [[no_unique_address]] node_allocator_type node_allocator;
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+    // Two updates per push and pop; kept out of default builds.
+    sharded_counter node_count;
+    sharded_counter value_count;
+#endif
+    // Consumers parked in wait_pop(). Its own line: pushes read it, parking
+    // and waking write it. A queue_set the queue is added to points
+    // not_empty at the set's event_count instead, so one push wakes either.
+    alignas(64) event_count own_events;
+    event_count* not_empty = &own_events;
+
+    friend class queue_set;
+#ifndef NDEBUG
+    // References currently held by threads, across all nodes: an upper bound
+    // for any single node's count.
+    std::atomic<std::int64_t> held_references{0};
+#endif
+
+    struct value_deleter {
+        [[no_unique_address]] value_allocator_type allocator;
+
+        void operator()(T* p) {
+            value_traits::destroy(allocator, p);
+            value_traits::deallocate(allocator, p, 1);
         }
     };
 
 public:
-    lock_free_queue() {
-        node* dummy = new node;
-        counted_node_ptr dummy_ptr;
-        dummy_ptr.ptr = dummy;
-        dummy_ptr.external_count = 1;
-        head.store(dummy_ptr);
-        tail.store(dummy_ptr);
+    using allocator_type = Allocator;
+    // Owns a popped value; plain std::unique_ptr<T> with the default allocator.
+    using value_ptr = std::unique_ptr<T, std::conditional_t<default_allocator, std::default_delete<T>, value_deleter>>;
+
+    explicit lock_free_queue(const Allocator& alloc = Allocator())
+        : value_allocator(alloc), node_allocator(alloc) {
+        counted_node_ptr const dummy = counted_node_ptr::make(create_node(), 1);
+        head.store(dummy);
+        tail.store(dummy);
     }
 
+    lock_free_queue(const lock_free_queue&) = delete;
+    lock_free_queue& operator=(const lock_free_queue&) = delete;
+
     ~lock_free_queue() {
-        while (pop()) {}
-        node* front = head.load().ptr;
-        delete front;
+        assert(not_empty == &own_events && "queue destroyed while still in a queue_set");
+        while (std::optional<stored_type> const value = pop_data(nullptr)) {
+            if constexpr (!inline_value) {
+                make_value_ptr(*value).reset();
+            }
+        }
+        destroy_node(head.load().ptr());
+    }
+
+    allocator_type get_allocator() const { return allocator_type(value_allocator); }
+
+    // Pushes return false, dropping the value, once the queue is closed.
+    bool push(const T& new_value) {
+        return emplace(new_value);
+    }
+
+    bool push(T&& new_value) {
+        return emplace(std::move(new_value));
+    }
+
+    // Constructs the value directly in the queue's storage.
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        if constexpr (inline_value) {
+            return push_stored(T(std::forward<Args>(args)...));
+        } else {
+            value_ptr new_data = create_value(std::forward<Args>(args)...);
+            if (!push_stored(new_data.get())) {
+                return false;
+            }
+            new_data.release();
+            return true;
+        }
+    }
+
+    // Makes every later push fail and wakes the consumers in wait_pop(). Items
+    // already pushed can still be popped; after the last one, pops report
+    // queue_op_status::closed. Pushes racing with close() either land before
+    // it or fail. Safe to call more than once.
+    void close() {
+        counted_node_ptr old_tail = tail.load();
+        for (;;) {
+            increase_external_count(tail, old_tail);
+            node* const tail_node = old_tail.ptr();
+            bool const closed = tail_node->claim_closed();
+            release_ref(tail_node);
+            if (closed) {
+                break;
+            }
+        }
+        not_empty->notify();
+    }
+
+    // For values stored inline this allocates the returned copy after the item
+    // has been taken; prefer try_pop for them.
+    value_ptr pop() {
+        std::optional<stored_type> const value = pop_data(nullptr);
+        if (!value) {
+            return nullptr;
+        }
+        return take_value_ptr(*value);
+    }
+
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+    // Also reports how long the item sat in the queue, in cycle_clock ticks,
+    // and records it in the queue's sojourn histogram. Untouched when empty.
+    value_ptr pop(std::uint64_t& sojourn) {
+        std::optional<stored_type> const value = pop_data(&sojourn);
+        if (!value) {
+            return nullptr;
+        }
+        return take_value_ptr(*value);
+    }
+#endif
+
+    // Moves the front value into out; returns false if the queue was empty.
+    bool try_pop(T& out) {
+        std::optional<stored_type> const value = pop_data(nullptr);
+        if (!value) {
+            return false;
+        }
+        if constexpr (inline_value) {
+            out = *value;
+        } else {
+            value_ptr const res = make_value_ptr(*value);
+            out = std::move(*res);
+        }
+        return true;
+    }
+
+    std::optional<T> try_pop() {
+        std::optional<stored_type> const value = pop_data(nullptr);
+        if (!value) {
+            return std::nullopt;
+        }
+        if constexpr (inline_value) {
+            return *value;
+        } else {
+            value_ptr const res = make_value_ptr(*value);
+            return std::optional<T>(std::move(*res));
+        }
+    }
+
+    // Whether the queue held nothing at some instant during the call.
+    bool empty() const { return head.load().ptr() == tail.load().ptr(); }
+
+    // As try_pop(T&), but an empty queue that has been closed reports closed.
+    queue_op_status nonblocking_pop(T& out) {
+        bool closed = false;
+        std::optional<stored_type> const value = pop_data(nullptr, &closed);
+        if (!value) {
+            return closed ? queue_op_status::closed : queue_op_status::empty;
+        }
+        if constexpr (inline_value) {
+            out = *value;
+        } else {
+            value_ptr const res = make_value_ptr(*value);
+            out = std::move(*res);
+        }
+        return queue_op_status::success;
+    }
+
+    // Sleeps while the queue is empty and open. Returns success with the front
+    // value, or closed once the queue is closed and drained.
+    queue_op_status wait_pop(T& out) {
+        for (;;) {
+            queue_op_status status = nonblocking_pop(out);
+            if (status != queue_op_status::empty) {
+                return status;
+            }
+            event_count::key const key = not_empty->prepare_wait();
+            status = nonblocking_pop(out);
+            if (status != queue_op_status::empty) {
+                not_empty->cancel_wait();
+                return status;
+            }
+            not_empty->wait(key);
+        }
     }
 
-    void push(T new_value) {
-        std::unique_ptr<T> new_data(new T(std::move(new_value)));
-        counted_node_ptr new_next;
-        new_next.ptr = new node;
-        new_next.external_count = 1;
+    // Current footprint. Counts are approximate while pushes and pops are in
+    // flight. Pooled figures are filled in when the node allocator exposes
+    // pool_stats(), as the block_pool based allocators do. live_counts says
+    // whether the live counts are this queue's, the pool's, or missing.
+    queue_memory_usage memory_usage() const {
+        queue_memory_usage usage;
+        usage.node_size = sizeof(node);
+        if constexpr (!inline_value) {
+            usage.value_size = sizeof(T);
+        }
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+        usage.live_counts = memory_count_scope::per_queue;
+        usage.live_nodes = static_cast<std::size_t>(std::max<std::int64_t>(node_count.load(), 0));
+        if constexpr (!inline_value) {
+            usage.live_values = static_cast<std::size_t>(std::max<std::int64_t>(value_count.load(), 0));
+        }
+#endif
+        if constexpr (requires { node_allocator_type::pool_stats(); }) {
+            auto const stats = node_allocator_type::pool_stats();
+#ifndef LOCK_FREE_QUEUE_MEMORY_STATS
+            usage.live_counts = memory_count_scope::pool_wide;
+            usage.live_nodes = stats.total_blocks - stats.free_blocks;
+#endif
+            usage.pooled_nodes = stats.free_blocks;
+            usage.pooled_bytes = stats.free_blocks * stats.block_size;
+            usage.retained_bytes = stats.retained_bytes;
+            usage.released_bytes = stats.released_bytes;
+        }
+        return usage;
+    }
+
+    // Hands pooled node memory beyond max_retained bytes back to the OS when
+    // the node allocator supports trim(); returns the bytes released. The pool
+    // is shared with other queues of the same node shape. Safe to call while
+    // other threads push and pop.
+    std::size_t trim(std::size_t max_retained) {
+        if constexpr (requires { node_allocator_type::trim(max_retained); }) {
+            return node_allocator_type::trim(max_retained);
+        } else {
+            return 0;
+        }
+    }
+
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+    const log2_histogram& sojourn_histogram() const { return sojourn_cycles; }
+#endif
+
+private:
+    node* create_node() {
+        node* const p = node_traits::allocate(node_allocator, 1);
+        try {
+            node_traits::construct(node_allocator, p);
+        } catch (...) {
+            node_traits::deallocate(node_allocator, p, 1);
+            throw;
+        }
+        count_nodes(1);
+        return p;
+    }
+
+    void destroy_node(node* p) {
+        LFQ_TRACE(node_delete, p);
+        node_traits::destroy(node_allocator, p);
+        node_traits::deallocate(node_allocator, p, 1);
+        count_nodes(-1);
+    }
+
+    void count_nodes([[maybe_unused]] std::int64_t delta) {
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+        node_count.add(delta);
+#endif
+    }
+
+    void count_values([[maybe_unused]] std::int64_t delta) {
+#ifdef LOCK_FREE_QUEUE_MEMORY_STATS
+        if constexpr (!inline_value) {
+            value_count.add(delta);
+        }
+#endif
+    }
+
+    template <typename... Args>
+    value_ptr create_value(Args&&... args) {
+        if constexpr (default_allocator) {
+            return value_ptr(new T(std::forward<Args>(args)...));
+        } else {
+            T* const p = value_traits::allocate(value_allocator, 1);
+            try {
+                value_traits::construct(value_allocator, p, std::forward<Args>(args)...);
+            } catch (...) {
+                value_traits::deallocate(value_allocator, p, 1);
+                throw;
+            }
+            return make_value_ptr(p);
+        }
+    }
+
+    value_ptr make_value_ptr(T* p) {
+        if constexpr (default_allocator) {
+            return value_ptr(p);
+        } else {
+            return value_ptr(p, value_deleter{value_allocator});
+        }
+    }
+
+    value_ptr take_value_ptr(const stored_type& value) {
+        if constexpr (inline_value) {
+            return create_value(value);
+        } else {
+            return make_value_ptr(value);
+        }
+    }
+
+    // Links a value (or, for out-of-line values, its pointer) in at the tail;
+    // false if the queue is closed. Only node allocation can throw, and it
+    // does so before anything is linked.
+    bool push_stored(stored_type value) {
+        LFQ_TRACE(push_begin, this);
+        counted_node_ptr const new_next = counted_node_ptr::make(create_node(), 1);
         counted_node_ptr old_tail = tail.load();
 
         for (;;) {
             increase_external_count(tail, old_tail);
-            T* old_data = nullptr;
-            if (old_tail.ptr->data.compare_exchange_strong(old_data, new_data.get())) {
-                old_tail.ptr->next = new_next;
+            node* const tail_node = old_tail.ptr();
+            if (tail_node->claim()) {
+                ::new (tail_node->payload) stored_type(value);
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+                tail_node->enqueue_cycles = read_cycle_counter();
+#endif
+                tail_node->next = new_next;
                 old_tail = tail.exchange(new_next);
                 free_external_counter(old_tail);
-                new_data.release();
-                break;
+                count_values(1);
+                // The exchange above is seq_cst, which is what notify() needs.
+                not_empty->notify();
+                LFQ_TRACE(push_end, this);
+                return true;
+            }
+            if (tail_node->is_closed()) {
+                release_ref(tail_node);
+                destroy_node(new_next.ptr());
+                LFQ_TRACE(push_end, this);
+                return false;
             }
-            old_tail.ptr->release_ref();
+            LFQ_TRACE(push_retry, tail_node);
+            release_ref(tail_node);
         }
     }
 
-    std::unique_ptr<T> pop() {
+    // Unlinks the front node and copies out what it stores (for out-of-line
+    // values, ownership of the pointer passes to the caller), or returns
+    // nothing if the queue is empty, setting *closed if it is also closed.
+    std::optional<stored_type> pop_data([[maybe_unused]] std::uint64_t* sojourn, bool* closed = nullptr) {
+        LFQ_TRACE(pop_begin, this);
         counted_node_ptr old_head = head.load(std::memory_order_relaxed);
         for (;;) {
             increase_external_count(head, old_head);
-            node* const ptr = old_head.ptr;
-            if (ptr == tail.load().ptr) {
-                ptr->release_ref();
-                return std::unique_ptr<T>();
+            node* const ptr = old_head.ptr();
+            if (ptr == tail.load().ptr()) {
+                if (closed) {
+                    *closed = ptr->is_closed();
+                }
+                release_ref(ptr);
+                LFQ_TRACE(pop_empty, this);
+                return std::nullopt;
             }
             if (head.compare_exchange_strong(old_head, ptr->next)) {
-                T* const res = ptr->data.exchange(nullptr);
+                stored_type const out = ptr->stored();
+#ifdef LOCK_FREE_QUEUE_SOJOURN
+                std::uint64_t const waited = read_cycle_counter() - ptr->enqueue_cycles;
+                sojourn_cycles.record(waited);
+                if (sojourn) {
+                    *sojourn = waited;
+                }
+#endif
                 free_external_counter(old_head);
-                return std::unique_ptr<T>(res);
+                count_values(-1);
+                LFQ_TRACE(pop_end, this);
+                return out;
             }
-            ptr->release_ref();
+            LFQ_TRACE(pop_retry, ptr);
+            release_ref(ptr);
         }
     }
 
-private:
-    static void increase_external_count(std::atomic<counted_node_ptr>& counter,
-                                       counted_node_ptr& old_counter) {
-        counted_node_ptr new_counter;
+    void reference_dropped() {
+#ifndef NDEBUG
+        held_references.fetch_sub(1, std::memory_order_relaxed);
+#endif
+    }
+
+    void release_ref(node* ptr) {
+        LFQ_TRACE(release_ref, ptr);
+        reference_dropped();
+        node_counter old_counter = ptr->count.load(std::memory_order_relaxed);
+        node_counter new_counter;
         do {
             new_counter = old_counter;
-            ++new_counter.external_count;
+            new_counter.internal_count = (old_counter.internal_count - 1u) & count_mask;
+        }
+        // acq_rel: this thread's earlier reads of the node must happen before
+        // whichever thread drops the last reference and frees it.
+        while (!ptr->count.compare_exchange_strong(old_counter, new_counter,
+                                                   std::memory_order_acq_rel,
+                                                   std::memory_order_relaxed));
+        if (!new_counter.internal_count && !new_counter.external_count) {
+            destroy_node(ptr);
+        }
+    }
+
+    void increase_external_count(std::atomic<counted_node_ptr>& counter,
+                                 counted_node_ptr& old_counter) {
+#ifndef NDEBUG
+        std::int64_t const held = held_references.fetch_add(1, std::memory_order_relaxed) + 1;
+        assert(static_cast<std::uint64_t>(held) < max_concurrent_threads && "reference count would alias");
+#endif
+        counted_node_ptr new_counter;
+        do {
+            new_counter = counted_node_ptr::make(old_counter.ptr(), old_counter.external_count() + 1);
         }
         while (!counter.compare_exchange_strong(old_counter, new_counter,
                                                std::memory_order_acquire,
                                                std::memory_order_relaxed));
-        old_counter.external_count = new_counter.external_count;
+        old_counter = new_counter;
     }
-    static void free_external_counter(counted_node_ptr& old_node_ptr) {
-        node* const ptr = old_node_ptr.ptr;
-        int const count_increase = old_node_ptr.external_count - 2;
+
+    void free_external_counter(counted_node_ptr& old_node_ptr) {
+        node* const ptr = old_node_ptr.ptr();
+        LFQ_TRACE(free_external_counter, ptr);
+        reference_dropped();
+        std::uint32_t const count_increase = (old_node_ptr.external_count() - 2u) & count_mask;
         node_counter old_counter = ptr->count.load(std::memory_order_relaxed);
         node_counter new_counter;
         do {
+            assert(old_counter.external_count > 0 && "node retired more often than it was linked");
             new_counter = old_counter;
             --new_counter.external_count;
-            new_counter.internal_count += count_increase;
+            new_counter.internal_count = (old_counter.internal_count + count_increase) & count_mask;
         }
         while (!ptr->count.compare_exchange_strong(old_counter, new_counter,
-                                                  std::memory_order_acquire,
+                                                  std::memory_order_acq_rel,
                                                   std::memory_order_relaxed));
 
         if (!new_counter.internal_count && !new_counter.external_count) {
-            delete ptr;
+            destroy_node(ptr);
         }
     }
 };
 
-#endif //QUEUE_H
\ No newline at end of file
+#endif //QUEUE_H
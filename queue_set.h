@@ -0,0 +1,124 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef QUEUE_SET_H
+#define QUEUE_SET_H
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <vector>
+#include "event_count.h"
+#include "queue.h"
+
+// A group of lock_free_queues a worker serves together. select() returns the
+// index of a queue that has items, sleeping while all of them are empty, so
+// an idle worker costs nothing and a busy one does not poll every queue on
+// every pop.
+//
+// Adding a queue points its wake-ups at the set's event_count: a push reads
+// one waiter count, and only touches it when a worker is parked. The queues
+// may hold different types.
+//
+// Add every queue before it is used, and keep the set alive while anything
+// pushes to them. A queue can be in one set at a time; wait_pop() on it keeps
+// working, sharing the set's wake-ups. Destroy the set before its queues: the
+// set's destructor hands each queue its own wake-ups back, and a queue
+// asserts in debug builds that it is no longer in a set when it is destroyed.
+class queue_set {
+private:
+    struct member {
+        void* queue;
+        bool (*empty)(const void*);
+        void (*detach)(void*);
+    };
+
+    event_count events;
+    std::vector<member> members;
+    std::atomic<bool> closed{false};
+
+    // First non-empty queue, starting from the caller's position and moving
+    // it on each time, so one busy queue does not starve the others. Each
+    // worker rotates its own position; nothing shared is written.
+    std::optional<std::size_t> find_ready(std::size_t& position) const {
+        std::size_t const n = members.size();
+        std::size_t const start = position++;
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t const index = (start + i) % n;
+            if (!members[index].empty(members[index].queue)) {
+                return index;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Scan position for callers that do not keep their own.
+    static std::size_t& thread_position() {
+        thread_local std::size_t position = 0;
+        return position;
+    }
+
+public:
+    queue_set() = default;
+    queue_set(const queue_set&) = delete;
+    queue_set& operator=(const queue_set&) = delete;
+
+    ~queue_set() {
+        for (const member& m : members) {
+            m.detach(m.queue);
+        }
+    }
+
+    // Registers a queue and returns the index select() reports it by. Not
+    // thread-safe.
+    template <typename T, typename Allocator>
+    std::size_t add(lock_free_queue<T, Allocator>& queue) {
+        using queue_type = lock_free_queue<T, Allocator>;
+        assert(queue.not_empty == &queue.own_events && "queue is already in a queue_set");
+        queue.not_empty = &events;
+        members.push_back({&queue,
+                           [](const void* q) { return static_cast<const queue_type*>(q)->empty(); },
+                           [](void* q) {
+                               auto* const typed = static_cast<queue_type*>(q);
+                               typed->not_empty = &typed->own_events;
+                           }});
+        return members.size() - 1;
+    }
+
+    std::size_t size() const { return members.size(); }
+
+    // Index of a queue that was non-empty, or nothing if all were. position
+    // is where the scan starts; keep one per worker per set. The overloads
+    // without it use one position per thread.
+    std::optional<std::size_t> try_select(std::size_t& position) const { return find_ready(position); }
+    std::optional<std::size_t> try_select() const { return find_ready(thread_position()); }
+
+    // Sleeps until some queue is non-empty and returns its index. Another
+    // consumer may still pop the item first, so the caller's pop can fail.
+    // Returns nothing once the set is closed and every queue is empty.
+    std::optional<std::size_t> select(std::size_t& position) {
+        for (;;) {
+            if (std::optional<std::size_t> const ready = find_ready(position)) {
+                return ready;
+            }
+            event_count::key const key = events.prepare_wait();
+            std::optional<std::size_t> const ready = find_ready(position);
+            if (ready || closed.load()) {
+                events.cancel_wait();
+                return ready;
+            }
+            events.wait(key);
+        }
+    }
+    std::optional<std::size_t> select() { return select(thread_position()); }
+
+    // Wakes every worker in select(); from then on select() returns nothing
+    // once the queues are drained. The queues themselves stay open.
+    void close() {
+        closed.store(true);
+        events.notify();
+    }
+};
+
+#endif //QUEUE_SET_H
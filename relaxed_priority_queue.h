@@ -0,0 +1,143 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef RELAXED_PRIORITY_QUEUE_H
+#define RELAXED_PRIORITY_QUEUE_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// MultiQueue-style relaxed priority queue: the items are spread over several
+// small binary heaps, each behind its own mutex. push() puts an item into a
+// random heap; pop_min() looks at the cached minimum of two random heaps and
+// takes from the better one. A heap whose lock is taken is skipped and another
+// one drawn, so threads only wait on each other in the sweep a pop falls back
+// to when the queue is nearly empty.
+//
+// pop_min() returns an item close to, but not always exactly, the global
+// minimum; with c * threads heaps the expected rank of a popped item is O(c *
+// threads). Only a pop that finds every heap empty reports empty.
+template <typename T, typename Priority = std::uint64_t>
+class relaxed_priority_queue {
+private:
+    static_assert(std::is_arithmetic_v<Priority>, "priorities are cached in an atomic");
+
+    struct entry {
+        Priority priority;
+        T value;
+    };
+
+    struct alignas(64) sub_queue {
+        std::mutex m;
+        std::vector<entry> heap;
+        // Smallest priority in heap, read without the lock to pick a heap.
+        std::atomic<Priority> top{std::numeric_limits<Priority>::max()};
+    };
+
+    static constexpr int sample_attempts = 8;
+
+    std::unique_ptr<sub_queue[]> queues;
+    std::size_t const queue_count;
+
+    static bool later(const entry& a, const entry& b) { return a.priority > b.priority; }
+
+    static std::uint64_t next_random() {
+        thread_local std::uint64_t state =
+            std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    sub_queue& random_queue() { return queues[next_random() % queue_count]; }
+
+    static void publish_top(sub_queue& q) {
+        q.top.store(q.heap.empty() ? std::numeric_limits<Priority>::max() : q.heap.front().priority,
+                    std::memory_order_relaxed);
+    }
+
+    // Called with q locked and non-empty.
+    static void take(sub_queue& q, Priority& priority, T& out) {
+        std::pop_heap(q.heap.begin(), q.heap.end(), later);
+        priority = q.heap.back().priority;
+        out = std::move(q.heap.back().value);
+        q.heap.pop_back();
+        publish_top(q);
+    }
+
+public:
+    // Defaults to two heaps per hardware thread, the usual MultiQueue setting.
+    explicit relaxed_priority_queue(std::size_t sub_queues = 2 * std::max(1u, std::thread::hardware_concurrency()))
+        : queues(new sub_queue[std::max<std::size_t>(sub_queues, 2)]),
+          queue_count(std::max<std::size_t>(sub_queues, 2)) {}
+
+    relaxed_priority_queue(const relaxed_priority_queue&) = delete;
+    relaxed_priority_queue& operator=(const relaxed_priority_queue&) = delete;
+
+    void push(Priority priority, T value) {
+        for (;;) {
+            sub_queue& q = random_queue();
+            std::unique_lock<std::mutex> lock(q.m, std::try_to_lock);
+            if (!lock) {
+                continue;
+            }
+            q.heap.push_back(entry{priority, std::move(value)});
+            std::push_heap(q.heap.begin(), q.heap.end(), later);
+            publish_top(q);
+            return;
+        }
+    }
+
+    // Pops an item with a small priority; returns false only if every heap
+    // was empty when it was visited.
+    bool pop_min(Priority& priority, T& out) {
+        for (int attempt = 0; attempt < sample_attempts; ++attempt) {
+            sub_queue& a = random_queue();
+            sub_queue& b = random_queue();
+            sub_queue& q = b.top.load(std::memory_order_relaxed) < a.top.load(std::memory_order_relaxed) ? b : a;
+            std::unique_lock<std::mutex> lock(q.m, std::try_to_lock);
+            if (lock && !q.heap.empty()) {
+                take(q, priority, out);
+                return true;
+            }
+        }
+        // Sampling kept missing, so the queue is nearly empty: sweep every
+        // heap before calling it empty.
+        for (std::size_t i = 0; i < queue_count; ++i) {
+            std::lock_guard<std::mutex> lock(queues[i].m);
+            if (!queues[i].heap.empty()) {
+                take(queues[i], priority, out);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool pop_min(T& out) {
+        Priority priority;
+        return pop_min(priority, out);
+    }
+
+    std::optional<std::pair<Priority, T>> pop_min() {
+        std::pair<Priority, T> item;
+        if (!pop_min(item.first, item.second)) {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    std::size_t sub_queue_count() const { return queue_count; }
+};
+
+#endif //RELAXED_PRIORITY_QUEUE_H
@@ -0,0 +1,46 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef SHARDED_COUNTER_H
+#define SHARDED_COUNTER_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Counter split over cache-line-sized shards, each thread updating the shard
+// it was assigned on first use, so bookkeeping on hot paths does not turn into
+// one contended line. load() sums the shards and is exact only once updates
+// have stopped.
+class sharded_counter {
+private:
+    static constexpr std::size_t shard_count = 8;
+
+    struct alignas(64) shard {
+        std::atomic<std::int64_t> value{0};
+    };
+
+    std::array<shard, shard_count> shards;
+
+    static std::size_t shard_index() {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t const index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+        return index;
+    }
+
+public:
+    void add(std::int64_t delta) {
+        shards[shard_index()].value.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    std::int64_t load() const {
+        std::int64_t sum = 0;
+        for (const auto& s : shards) {
+            sum += s.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+#endif //SHARDED_COUNTER_H
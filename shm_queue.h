@@ -0,0 +1,356 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+#if defined(__unix__) || defined(__APPLE__)
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spin_wait.h"
+
+// Bounded MPMC queue living entirely inside a shm_open segment, so processes
+// that map it (at whatever address) can pass T between them without sockets.
+// There are no pointers in the segment: slots are found by position, which
+// makes it position-independent, and all memory is the fixed slot arena
+// created with the segment.
+//
+// Each slot has one word holding the lap position it is on, its state and the
+// pid of the process working on it; claiming a slot is a single CAS on that
+// word, so a slot is never held without its holder being recorded. Positions
+// then move on by CAS, helped along by anyone who finds them behind.
+//
+// Crashed peers: a slot left mid-write or mid-read by a process that no longer
+// exists is noticed by the next process stuck behind it (after it has seen the
+// slot unchanged for a while, it checks the pid with kill(pid, 0)). A dead
+// writer's slot is skipped, so that item never appears; a dead reader's slot
+// is reused, so the item it was reading is lost. Every other item is
+// delivered once. A recycled pid makes its dead predecessor look alive.
+//
+// A shm_queue handle records the pid of the process that made it; a child
+// process should open() its own rather than use one inherited through fork().
+template <typename T>
+class shm_queue {
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "values are copied between processes byte for byte");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "atomics must be address-free");
+
+    enum state : std::uint64_t {
+        free_slot = 0,  // ready for the producer of its position
+        writing = 1,
+        published = 2,
+        reading = 3,
+        abandoned = 4,  // writer died; consumers skip it
+    };
+
+    static constexpr int state_bits = 3;
+    static constexpr int pid_bits = 22;  // Linux pid_max is at most 2^22
+    static constexpr int pid_shift = state_bits;
+    static constexpr int pos_shift = state_bits + pid_bits;
+    // Positions are kept modulo 2^39 in slot words.
+    static constexpr std::uint64_t pos_mask = (std::uint64_t(1) << (64 - pos_shift)) - 1;
+    static constexpr std::uint64_t magic_value = 0x73686d5f71756575ull;  // "shm_queu"
+    static constexpr int stuck_checks = 1024;
+
+    static std::uint64_t make(std::uint64_t pos, std::uint64_t pid, state s) {
+        return pos << pos_shift | (pid & ((std::uint64_t(1) << pid_bits) - 1)) << pid_shift | s;
+    }
+    // How far the lap in slot word w is ahead of pos, modulo 2^39; a lap
+    // behind pos comes out huge.
+    static std::uint64_t lap_ahead(std::uint64_t w, std::uint64_t pos) { return ((w >> pos_shift) - pos) & pos_mask; }
+    static pid_t pid_of(std::uint64_t w) {
+        return static_cast<pid_t>((w >> pid_shift) & ((std::uint64_t(1) << pid_bits) - 1));
+    }
+    static state state_of(std::uint64_t w) { return static_cast<state>(w & ((1u << state_bits) - 1)); }
+
+    struct slot {
+        std::atomic<std::uint64_t> word;
+        T value;
+    };
+
+    // Start of the segment; the slot array follows it.
+    struct alignas(64) segment {
+        std::atomic<std::uint64_t> magic;
+        std::uint64_t capacity = 0;
+        std::uint64_t slot_size = 0;
+        alignas(64) std::atomic<std::uint64_t> enqueue_pos;
+        alignas(64) std::atomic<std::uint64_t> dequeue_pos;
+    };
+
+    segment* seg = nullptr;
+    slot* slots = nullptr;
+    std::size_t mapped_bytes = 0;
+    std::uint64_t mask = 0;
+    std::uint64_t self = 0;
+
+    static std::size_t segment_bytes(std::size_t capacity) { return sizeof(segment) + capacity * sizeof(slot); }
+
+    slot& slot_at(std::uint64_t pos) { return slots[pos & mask]; }
+
+    // Whether the holder of a slot word that has not changed for a while is
+    // gone. Cheap until the same word has been seen stuck stuck_checks times.
+    static bool holder_died(std::uint64_t w) {
+        thread_local std::uint64_t last = 0;
+        thread_local int seen = 0;
+        if (w != last) {
+            last = w;
+            seen = 0;
+            return false;
+        }
+        if (++seen < stuck_checks) {
+            return false;
+        }
+        seen = 0;
+        pid_t const pid = pid_of(w);
+        return pid != 0 && kill(pid, 0) != 0 && errno == ESRCH;
+    }
+
+    [[noreturn]] static void fail(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    shm_queue(segment* s, std::size_t bytes)
+        : seg(s), slots(reinterpret_cast<slot*>(s + 1)), mapped_bytes(bytes), mask(s->capacity - 1),
+          self(static_cast<std::uint64_t>(getpid())) {}
+
+    static void* map(int fd, std::size_t bytes) {
+        void* const p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int const error = errno;
+        close(fd);
+        if (p == MAP_FAILED) {
+            errno = error;
+            fail("mmap");
+        }
+        return p;
+    }
+
+public:
+    // A claimed slot: write (or read) *value in place, then commit.
+    struct slot_ref {
+        T* value = nullptr;
+        std::uint64_t pos = 0;
+
+        explicit operator bool() const { return value != nullptr; }
+    };
+
+    // Creates and maps a new segment; capacity must be a power of two.
+    static shm_queue create(const std::string& name, std::size_t capacity) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("shm_queue capacity must be a power of two");
+        }
+        int const fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            fail("shm_open");
+        }
+        std::size_t const bytes = segment_bytes(capacity);
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            int const error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            errno = error;
+            fail("ftruncate");
+        }
+        void* p;
+        try {
+            p = map(fd, bytes);
+        } catch (...) {
+            shm_unlink(name.c_str());
+            throw;
+        }
+        auto* const s = new (p) segment;
+        s->capacity = capacity;
+        s->slot_size = sizeof(slot);
+        auto* const arena = reinterpret_cast<slot*>(s + 1);
+        for (std::size_t i = 0; i < capacity; ++i) {
+            new (&arena[i]) slot{make(i, 0, free_slot), T{}};
+        }
+        // Openers wait for the magic, so it goes in last.
+        s->magic.store(magic_value, std::memory_order_release);
+        return shm_queue(s, bytes);
+    }
+
+    // Maps a segment another process created, waiting up to a second for it
+    // to be sized and initialised.
+    static shm_queue open(const std::string& name) {
+        int const fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            fail("shm_open");
+        }
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        std::size_t bytes = 0;
+        for (;;) {
+            struct stat st{};
+            if (fstat(fd, &st) != 0) {
+                int const error = errno;
+                close(fd);
+                errno = error;
+                fail("fstat");
+            }
+            bytes = static_cast<std::size_t>(st.st_size);
+            // The creator may not have sized the segment yet.
+            if (bytes >= segment_bytes(2)) {
+                break;
+            }
+            if (std::chrono::steady_clock::now() > deadline) {
+                close(fd);
+                throw std::runtime_error("shm_queue segment '" + name + "' is too small");
+            }
+            std::this_thread::yield();
+        }
+        auto* const s = static_cast<segment*>(map(fd, bytes));
+        while (s->magic.load(std::memory_order_acquire) != magic_value) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                munmap(s, bytes);
+                throw std::runtime_error("shm_queue segment '" + name + "' was never initialised");
+            }
+            std::this_thread::yield();
+        }
+        if (s->slot_size != sizeof(slot) || bytes < segment_bytes(s->capacity)) {
+            munmap(s, bytes);
+            throw std::runtime_error("shm_queue segment '" + name + "' holds a different type or size");
+        }
+        return shm_queue(s, bytes);
+    }
+
+    // Removes the name; mapped segments stay usable until unmapped.
+    static void unlink(const std::string& name) { shm_unlink(name.c_str()); }
+
+    shm_queue(shm_queue&& other) noexcept
+        : seg(std::exchange(other.seg, nullptr)), slots(other.slots), mapped_bytes(other.mapped_bytes),
+          mask(other.mask), self(other.self) {}
+
+    shm_queue(const shm_queue&) = delete;
+    shm_queue& operator=(const shm_queue&) = delete;
+    shm_queue& operator=(shm_queue&&) = delete;
+
+    ~shm_queue() {
+        if (seg) {
+            munmap(seg, mapped_bytes);
+        }
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // Claims the next slot to write; false if the queue is full.
+    bool try_begin_push(slot_ref& out) {
+        for (;;) {
+            std::uint64_t pos = seg->enqueue_pos.load(std::memory_order_acquire);
+            slot& sl = slot_at(pos);
+            std::uint64_t w = sl.word.load(std::memory_order_acquire);
+            std::uint64_t const ahead = lap_ahead(w, pos);
+            if (ahead == 0 && state_of(w) == free_slot) {
+                if (sl.word.compare_exchange_strong(w, make(pos, self, writing))) {
+                    seg->enqueue_pos.compare_exchange_strong(pos, pos + 1);
+                    out = {&sl.value, pos};
+                    return true;
+                }
+            } else if (ahead == 0) {
+                // Claimed, but enqueue_pos was not moved on yet.
+                seg->enqueue_pos.compare_exchange_strong(pos, pos + 1);
+            } else if (ahead == ((pos_mask + 1 - capacity()) & pos_mask)) {
+                // The previous lap's item is still there: full, unless its
+                // reader died holding it.
+                if (state_of(w) == reading && holder_died(w)) {
+                    sl.word.compare_exchange_strong(w, make(pos, 0, free_slot));
+                    continue;
+                }
+                return false;
+            }
+        }
+    }
+
+    void commit_push(const slot_ref& r) {
+        slot_at(r.pos).word.store(make(r.pos, 0, published), std::memory_order_release);
+    }
+
+    // Claims the oldest published slot to read; false if the queue is empty
+    // or its oldest item is still being written.
+    bool try_begin_pop(slot_ref& out) {
+        for (;;) {
+            std::uint64_t pos = seg->dequeue_pos.load(std::memory_order_acquire);
+            slot& sl = slot_at(pos);
+            std::uint64_t w = sl.word.load(std::memory_order_acquire);
+            std::uint64_t const ahead = lap_ahead(w, pos);
+            if (ahead != 0) {
+                if (ahead <= capacity()) {
+                    continue;  // dequeue_pos moved on under us
+                }
+                return false;  // not written on this lap yet
+            }
+            switch (state_of(w)) {
+            case published:
+                if (sl.word.compare_exchange_strong(w, make(pos, self, reading))) {
+                    seg->dequeue_pos.compare_exchange_strong(pos, pos + 1);
+                    out = {&sl.value, pos};
+                    return true;
+                }
+                break;
+            case writing:
+                if (!holder_died(w)) {
+                    return false;
+                }
+                sl.word.compare_exchange_strong(w, make(pos, 0, abandoned));
+                break;
+            case abandoned:
+                if (sl.word.compare_exchange_strong(w, make(pos + capacity(), 0, free_slot))) {
+                    seg->dequeue_pos.compare_exchange_strong(pos, pos + 1);
+                }
+                break;
+            case reading:
+                seg->dequeue_pos.compare_exchange_strong(pos, pos + 1);
+                break;
+            case free_slot:
+                return false;
+            }
+        }
+    }
+
+    void commit_pop(const slot_ref& r) {
+        slot_at(r.pos).word.store(make(r.pos + capacity(), 0, free_slot), std::memory_order_release);
+    }
+
+    bool try_push(const T& value) {
+        slot_ref r;
+        if (!try_begin_push(r)) {
+            return false;
+        }
+        *r.value = value;
+        commit_push(r);
+        return true;
+    }
+
+    void push(const T& value) {
+        spin_backoff backoff;
+        while (!try_push(value)) {
+            backoff.pause();
+        }
+    }
+
+    bool try_pop(T& out) {
+        slot_ref r;
+        if (!try_begin_pop(r)) {
+            return false;
+        }
+        out = *r.value;
+        commit_pop(r);
+        return true;
+    }
+};
+
+#endif
+#endif //SHM_QUEUE_H
@@ -0,0 +1,392 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef SPILLING_QUEUE_H
+#define SPILLING_QUEUE_H
+#if defined(__unix__) || defined(__APPLE__)
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "queue.h"
+
+struct spill_options {
+    std::string directory;                  // must exist; segment files are created in it
+    std::size_t memory_threshold = 1 << 20;  // items held in memory before spilling starts
+    std::size_t segment_records = 1 << 20;   // records per segment file
+    std::size_t sync_every = 4096;           // records appended between msyncs
+    std::size_t page_in_batch = 4096;        // records moved back into memory at a time
+    bool keep_on_close = false;             // leave unread spilled records for the next run
+};
+
+struct spill_stats {
+    std::size_t spilled = 0;       // records ever written to disk
+    std::size_t paged_in = 0;      // records ever read back
+    std::size_t on_disk = 0;       // written and not yet read back
+    std::size_t segments = 0;      // segment files currently open
+    std::size_t msync_calls = 0;
+    std::size_t recovered = 0;     // records found on disk at construction
+};
+
+// Append-only log of T in a directory of fixed-size segment files, each
+// mapped while it is being written or read. Records carry their sequence
+// number, so after a crash the valid prefix of every segment is found by
+// scanning rather than trusting a count. Not thread-safe; spilling_queue
+// serialises access.
+template <typename T>
+class spill_log {
+private:
+    static constexpr std::uint64_t magic_value = 0x6c66712d7370696cull;  // "lfq-spil"
+    static constexpr std::size_t header_bytes = 4096;
+
+    struct record {
+        std::uint64_t seq;  // 0 for never written
+        T value;
+    };
+
+    struct header {
+        std::uint64_t magic;
+        std::uint64_t record_size;
+        std::uint64_t first_seq;
+        std::uint64_t read_count;  // records already paged back in
+    };
+
+    struct segment {
+        std::string path;
+        void* base = nullptr;
+        std::size_t bytes = 0;
+        std::size_t written = 0;
+        std::size_t synced = 0;
+        std::size_t read = 0;  // paged in; the header's read_count lags behind
+        bool sealed = false;  // full, or recovered from an earlier run: no more appends
+
+        header& head() const { return *static_cast<header*>(base); }
+        record* records() const {
+            return reinterpret_cast<record*>(static_cast<char*>(base) + header_bytes);
+        }
+    };
+
+    spill_options const options;
+    std::deque<segment> segments;  // oldest first; the back one is appended to
+    std::size_t reading = 0;       // index of the segment read() is in
+    std::uint64_t next_seq = 1;
+    std::uint64_t next_index = 0;
+    spill_stats counters;
+
+    [[noreturn]] static void fail(const char* what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    std::size_t segment_bytes() const { return header_bytes + options.segment_records * sizeof(record); }
+
+    std::string segment_path(std::uint64_t index) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "spill-%012llu.seg", static_cast<unsigned long long>(index));
+        return (std::filesystem::path(options.directory) / name).string();
+    }
+
+    static void* map_file(const std::string& path, std::size_t bytes, bool create) {
+        int const fd = ::open(path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0600);
+        if (fd < 0) {
+            fail("open spill segment");
+        }
+        if (create && ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            int const error = errno;
+            ::close(fd);
+            errno = error;
+            fail("ftruncate spill segment");
+        }
+        void* const p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int const error = errno;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            errno = error;
+            fail("mmap spill segment");
+        }
+        return p;
+    }
+
+    // Flushes the records appended since the last sync, as one msync, then
+    // unmaps the pages it filled so spilled data stops counting towards RSS;
+    // reading faults them back in from the file.
+    void sync(segment& s) {
+        if (s.written == s.synced) {
+            return;
+        }
+        auto const page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto const from = reinterpret_cast<std::uintptr_t>(s.records() + s.synced) & ~(page - 1);
+        auto const to = reinterpret_cast<std::uintptr_t>(s.records() + s.written);
+        if (msync(reinterpret_cast<void*>(from), to - from, MS_SYNC) != 0) {
+            fail("msync spill segment");
+        }
+        ++counters.msync_calls;
+        s.synced = s.written;
+        auto const full = to & ~(page - 1);
+        if (full > from) {
+            madvise(reinterpret_cast<void*>(from), full - from, MADV_DONTNEED);
+        }
+    }
+
+    // Flushes the header page, so recovery after an OS crash finds the magic
+    // and the latest read_count.
+    void sync_header(segment& s) {
+        if (msync(s.base, header_bytes, MS_SYNC) != 0) {
+            fail("msync spill segment header");
+        }
+        ++counters.msync_calls;
+    }
+
+    void close_segment(segment& s, bool remove) {
+        munmap(s.base, s.bytes);
+        if (remove) {
+            std::filesystem::remove(s.path);
+        }
+    }
+
+    void recover() {
+        std::vector<std::filesystem::path> found;
+        for (const auto& entry : std::filesystem::directory_iterator(options.directory)) {
+            std::string const name = entry.path().filename().string();
+            if (name.rfind("spill-", 0) == 0 && entry.path().extension() == ".seg") {
+                found.push_back(entry.path());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        for (const auto& path : found) {
+            auto const bytes = static_cast<std::size_t>(std::filesystem::file_size(path));
+            if (bytes < header_bytes + sizeof(record)) {
+                continue;
+            }
+            segment s{path.string(), map_file(path.string(), bytes, false), bytes};
+            if (s.head().magic != magic_value || s.head().record_size != sizeof(record)) {
+                close_segment(s, false);
+                continue;
+            }
+            std::size_t const capacity = (bytes - header_bytes) / sizeof(record);
+            while (s.written < capacity && s.records()[s.written].seq == s.head().first_seq + s.written) {
+                ++s.written;
+            }
+            s.synced = s.written;
+            s.read = std::min<std::size_t>(s.head().read_count, s.written);
+            s.sealed = true;
+            std::size_t const unread = s.written - s.read;
+            if (unread == 0) {
+                close_segment(s, true);
+                continue;
+            }
+            counters.recovered += unread;
+            counters.on_disk += unread;
+            next_seq = s.head().first_seq + s.written;
+            segments.push_back(s);
+        }
+        if (!found.empty()) {
+            unsigned long long last = 0;
+            std::sscanf(found.back().filename().string().c_str(), "spill-%llu.seg", &last);
+            next_index = last + 1;
+        }
+    }
+
+    std::size_t capacity_of(const segment& s) const { return (s.bytes - header_bytes) / sizeof(record); }
+
+public:
+    explicit spill_log(spill_options opts) : options(std::move(opts)) { recover(); }
+
+    spill_log(const spill_log&) = delete;
+    spill_log& operator=(const spill_log&) = delete;
+
+    ~spill_log() {
+        for (auto& s : segments) {
+            try {
+                sync(s);
+            } catch (const std::system_error&) {
+                // Nothing to report it to; the records stay in the page cache.
+            }
+            close_segment(s, !options.keep_on_close);
+        }
+    }
+
+    bool empty() const { return counters.on_disk == 0; }
+
+    void append(const T& value) {
+        if (segments.empty() || segments.back().sealed) {
+            std::string const path = segment_path(next_index++);
+            segment s{path, map_file(path, segment_bytes(), true), segment_bytes()};
+            s.head() = header{magic_value, sizeof(record), next_seq, 0};
+            segments.push_back(s);
+            sync_header(segments.back());
+        }
+        segment& s = segments.back();
+        s.records()[s.written] = record{next_seq++, value};
+        ++s.written;
+        ++counters.spilled;
+        ++counters.on_disk;
+        if (s.written == capacity_of(s)) {
+            sync(s);
+            s.sealed = true;
+        } else if (s.written - s.synced >= options.sync_every) {
+            sync(s);
+        }
+    }
+
+    // Reads the oldest unread record; false if there is none.
+    bool read(T& out) {
+        while (reading < segments.size()) {
+            segment& s = segments[reading];
+            if (s.read < s.written) {
+                out = s.records()[s.read++].value;
+                ++counters.paged_in;
+                --counters.on_disk;
+                return true;
+            }
+            if (!s.sealed) {
+                return false;  // caught up with the writer
+            }
+            ++reading;
+        }
+        return false;
+    }
+
+    // Records everything read so far as consumed: fully read segments are
+    // deleted and the rest's header remembers where reading got to, which is
+    // where a run recovering this directory starts.
+    void mark_consumed() {
+        for (; reading > 0; --reading) {
+            close_segment(segments.front(), true);
+            segments.pop_front();
+        }
+        if (!segments.empty() && segments.front().head().read_count != segments.front().read) {
+            segments.front().head().read_count = segments.front().read;
+            sync_header(segments.front());
+        }
+    }
+
+    spill_stats stats() const {
+        spill_stats s = counters;
+        s.segments = segments.size();
+        return s;
+    }
+};
+
+// lock_free_queue that stops growing in RAM: once memory_threshold items are
+// queued in memory, further pushes are appended to a spill_log on disk, and
+// pops page them back in, in order, once memory has drained. Items pushed by
+// one producer still come out in the order it pushed them.
+//
+// The in-memory path is the lock-free queue; the spill path takes a mutex,
+// which is fine for a mode that only runs while consumers are behind. msync is
+// issued every sync_every records rather than per record. Spilled records
+// survive a crash: a spilling_queue constructed on the same directory delivers
+// them first, starting from the last batch paged in (items of that batch that
+// were already popped come out again). Items that were only ever in memory
+// are lost with the process.
+//
+// It spills the newest items rather than the oldest, so FIFO order never
+// splices disk records ahead of memory ones.
+template <typename T, typename Allocator = std::allocator<T>>
+class spilling_queue {
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "spilled values are written to disk byte for byte");
+
+    lock_free_queue<T, Allocator> memory;
+    alignas(64) std::atomic<std::size_t> memory_depth{0};
+    alignas(64) std::atomic<bool> spilling{false};
+    std::atomic<std::size_t> on_disk{0};
+    std::mutex spill_mutex;
+    spill_log<T> log;
+    std::size_t const threshold;
+    std::size_t const page_in_batch;
+
+    void push_memory(const T& value) {
+        memory_depth.fetch_add(1, std::memory_order_relaxed);
+        memory.push(value);
+    }
+
+    // Called with spill_mutex held. Only pages in once every earlier paged-in
+    // item has been popped, so the log can mark them all consumed.
+    void page_in() {
+        if (memory_depth.load(std::memory_order_relaxed) != 0) {
+            return;
+        }
+        log.mark_consumed();
+        T value;
+        for (std::size_t i = 0; i < page_in_batch && log.read(value); ++i) {
+            push_memory(value);
+            on_disk.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (log.empty()) {
+            spilling.store(false, std::memory_order_release);
+        }
+    }
+
+public:
+    explicit spilling_queue(spill_options options)
+        : log(options), threshold(options.memory_threshold), page_in_batch(std::max<std::size_t>(options.page_in_batch, 1)) {
+        on_disk.store(log.stats().on_disk);
+        spilling.store(!log.empty());
+    }
+
+    spilling_queue(const spilling_queue&) = delete;
+    spilling_queue& operator=(const spilling_queue&) = delete;
+
+    void push(const T& value) {
+        if (!spilling.load(std::memory_order_acquire) && memory_depth.load(std::memory_order_relaxed) < threshold) {
+            push_memory(value);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        if (!spilling.load(std::memory_order_relaxed) && memory_depth.load(std::memory_order_relaxed) < threshold) {
+            push_memory(value);
+            return;
+        }
+        spilling.store(true, std::memory_order_relaxed);
+        log.append(value);
+        on_disk.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool try_pop(T& out) {
+        for (;;) {
+            if (memory.try_pop(out)) {
+                memory_depth.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+            if (on_disk.load(std::memory_order_relaxed) == 0) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(spill_mutex);
+            page_in();
+        }
+    }
+
+    std::optional<T> try_pop() {
+        T out;
+        if (!try_pop(out)) {
+            return std::nullopt;
+        }
+        return out;
+    }
+
+    std::size_t memory_size() const { return memory_depth.load(std::memory_order_relaxed); }
+
+    spill_stats stats() {
+        std::lock_guard<std::mutex> lock(spill_mutex);
+        return log.stats();
+    }
+};
+
+#endif
+#endif //SPILLING_QUEUE_H
@@ -0,0 +1,42 @@
+//
+// Created by Supradeep Chitumalla on 16/10/26.
+//
+
+#ifndef SPIN_WAIT_H
+#define SPIN_WAIT_H
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Tells the core we are spinning so a hyperthread sibling gets the pipeline
+// and the loop does not flood the memory system with speculative loads.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Spins briefly, then starts yielding the CPU. Use for waits that are expected
+// to be short but may land on an oversubscribed machine.
+class spin_backoff {
+private:
+    unsigned spins = 0;
+    static constexpr unsigned spin_limit = 64;
+
+public:
+    void pause() {
+        if (spins < spin_limit) {
+            ++spins;
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    void reset() { spins = 0; }
+};
+
+#endif //SPIN_WAIT_H
@@ -0,0 +1,309 @@
+//
+// Created by Supradeep Chitumalla on 16/10/26.
+//
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// CPU topology read straight from /sys/devices/system/cpu, so benchmarks can
+// place threads without linking libnuma. On systems without /sys every CPU is
+// reported as its own core on package 0, node 0.
+
+struct cpu_info {
+    int cpu = 0;
+    int core_id = 0;
+    int package_id = 0;
+    int numa_node = 0;
+};
+
+// Parses the kernel's cpulist format, e.g. "0-3,8,10-11".
+inline std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        std::size_t const dash = range.find('-');
+        try {
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(range));
+            } else {
+                int const first = std::stoi(range.substr(0, dash));
+                int const last = std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+class cpu_topology {
+private:
+    std::vector<cpu_info> cpus_;
+
+    static std::optional<int> read_int(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        int value;
+        if (in >> value) {
+            return value;
+        }
+        return std::nullopt;
+    }
+
+    static std::string read_line(const std::filesystem::path& path) {
+        std::ifstream in(path);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+public:
+    cpu_topology() = default;
+    explicit cpu_topology(std::vector<cpu_info> cpus) : cpus_(std::move(cpus)) {}
+
+    static cpu_topology detect() {
+        namespace fs = std::filesystem;
+        cpu_topology topology;
+        fs::path const root = "/sys/devices/system/cpu";
+        std::error_code ec;
+        std::vector<int> online = parse_cpu_list(read_line(root / "online"));
+        for (int cpu : online) {
+            fs::path const dir = root / ("cpu" + std::to_string(cpu));
+            cpu_info info;
+            info.cpu = cpu;
+            info.core_id = read_int(dir / "topology" / "core_id").value_or(cpu);
+            info.package_id = read_int(dir / "topology" / "physical_package_id").value_or(0);
+            for (const auto& entry : fs::directory_iterator(dir, ec)) {
+                std::string const name = entry.path().filename().string();
+                if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+                    std::all_of(name.begin() + 4, name.end(),
+                                [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; })) {
+                    info.numa_node = std::stoi(name.substr(4));
+                    break;
+                }
+            }
+            topology.cpus_.push_back(info);
+        }
+        if (topology.cpus_.empty()) {
+            unsigned const n = std::max(1u, std::thread::hardware_concurrency());
+            for (unsigned cpu = 0; cpu < n; ++cpu) {
+                cpu_info info;
+                info.cpu = static_cast<int>(cpu);
+                info.core_id = static_cast<int>(cpu);
+                topology.cpus_.push_back(info);
+            }
+        }
+        return topology;
+    }
+
+    const std::vector<cpu_info>& cpus() const { return cpus_; }
+
+    std::vector<int> packages() const {
+        std::set<int> ids;
+        for (const auto& info : cpus_) {
+            ids.insert(info.package_id);
+        }
+        return {ids.begin(), ids.end()};
+    }
+
+    std::vector<int> numa_nodes() const {
+        std::set<int> ids;
+        for (const auto& info : cpus_) {
+            ids.insert(info.numa_node);
+        }
+        return {ids.begin(), ids.end()};
+    }
+
+    std::optional<cpu_info> find(int cpu) const {
+        for (const auto& info : cpus_) {
+            if (info.cpu == cpu) {
+                return info;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Hardware threads grouped by physical core, for one package.
+    std::vector<std::vector<int>> cores_of_package(int package_id) const {
+        std::map<int, std::vector<int>> cores;
+        for (const auto& info : cpus_) {
+            if (info.package_id == package_id) {
+                cores[info.core_id].push_back(info.cpu);
+            }
+        }
+        std::vector<std::vector<int>> result;
+        for (auto& [core, threads] : cores) {
+            result.push_back(std::move(threads));
+        }
+        return result;
+    }
+
+    // One CPU per physical core first, then the remaining SMT siblings, so a
+    // prefix of the list never shares a core unless it has to.
+    std::vector<int> cpus_of_package(int package_id) const {
+        std::vector<std::vector<int>> const cores = cores_of_package(package_id);
+        std::vector<int> result;
+        for (std::size_t smt = 0;; ++smt) {
+            bool any = false;
+            for (const auto& threads : cores) {
+                if (smt < threads.size()) {
+                    result.push_back(threads[smt]);
+                    any = true;
+                }
+            }
+            if (!any) {
+                break;
+            }
+        }
+        return result;
+    }
+};
+
+// Pins the calling thread to one CPU. Returns false where the platform does
+// not support explicit affinity (e.g. macOS) or the CPU is not allowed.
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+enum class placement {
+    none,
+    smt_siblings,
+    same_socket,
+    cross_socket,
+    spread,
+};
+
+inline const char* placement_name(placement p) {
+    switch (p) {
+        case placement::none: return "unpinned";
+        case placement::smt_siblings: return "smt-siblings";
+        case placement::same_socket: return "same-socket";
+        case placement::cross_socket: return "cross-socket";
+        case placement::spread: return "spread";
+    }
+    return "?";
+}
+
+struct placement_plan {
+    std::vector<int> producer_cpus;
+    std::vector<int> consumer_cpus;
+    std::string error;
+
+    bool feasible() const { return error.empty(); }
+};
+
+// Chooses a CPU for every producer and consumer:
+//   smt_siblings  producer i and consumer i share a physical core
+//   same_socket   everything on the first package, distinct cores first
+//   cross_socket  producers on the first package, consumers on the second
+//   spread        producers and consumers each dealt round-robin across packages
+// Thread counts larger than the chosen CPU set wrap around it.
+inline placement_plan plan_placement(const cpu_topology& topology, placement strategy,
+                                     int num_producers, int num_consumers) {
+    placement_plan plan;
+    if (strategy == placement::none) {
+        return plan;
+    }
+#ifndef __linux__
+    plan.error = "thread affinity not supported on this platform";
+    return plan;
+#endif
+    std::vector<int> const packages = topology.packages();
+    auto assign = [](std::vector<int>& out, const std::vector<int>& cpus, int count) {
+        for (int i = 0; i < count; ++i) {
+            out.push_back(cpus[i % cpus.size()]);
+        }
+    };
+
+    switch (strategy) {
+        case placement::smt_siblings: {
+            std::vector<std::vector<int>> pairs;
+            for (const auto& threads : topology.cores_of_package(packages.front())) {
+                if (threads.size() >= 2) {
+                    pairs.push_back({threads[0], threads[1]});
+                }
+            }
+            if (pairs.empty()) {
+                plan.error = "no core with SMT siblings";
+                break;
+            }
+            for (int i = 0; i < num_producers; ++i) {
+                plan.producer_cpus.push_back(pairs[i % pairs.size()][0]);
+            }
+            for (int i = 0; i < num_consumers; ++i) {
+                plan.consumer_cpus.push_back(pairs[i % pairs.size()][1]);
+            }
+            break;
+        }
+        case placement::same_socket: {
+            std::vector<int> const cpus = topology.cpus_of_package(packages.front());
+            std::vector<int> all;
+            assign(all, cpus, num_producers + num_consumers);
+            plan.producer_cpus.assign(all.begin(), all.begin() + num_producers);
+            plan.consumer_cpus.assign(all.begin() + num_producers, all.end());
+            break;
+        }
+        case placement::cross_socket: {
+            if (packages.size() < 2) {
+                plan.error = "only one socket";
+                break;
+            }
+            assign(plan.producer_cpus, topology.cpus_of_package(packages[0]), num_producers);
+            assign(plan.consumer_cpus, topology.cpus_of_package(packages[1]), num_consumers);
+            break;
+        }
+        case placement::spread: {
+            std::vector<std::vector<int>> per_package;
+            for (int id : packages) {
+                per_package.push_back(topology.cpus_of_package(id));
+            }
+            std::vector<std::size_t> next(per_package.size(), 0);
+            auto deal = [&per_package, &next](std::vector<int>& out, int count) {
+                for (int i = 0; i < count; ++i) {
+                    std::size_t const package = i % per_package.size();
+                    const std::vector<int>& cpus = per_package[package];
+                    out.push_back(cpus[next[package]++ % cpus.size()]);
+                }
+            };
+            deal(plan.producer_cpus, num_producers);
+            deal(plan.consumer_cpus, num_consumers);
+            break;
+        }
+        case placement::none:
+            break;
+    }
+    return plan;
+}
+
+#endif //TOPOLOGY_H
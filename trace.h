@@ -0,0 +1,198 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef TRACE_H
+#define TRACE_H
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "cycle_clock.h"
+
+// Event tracing for lock_free_queue. Each thread writes fixed-size binary
+// records into its own ring buffer, so recording never touches a shared cache
+// line; when a ring is full the oldest records are overwritten. Rings outlive
+// their threads and can be converted to Chrome trace JSON, which Perfetto and
+// chrome://tracing load directly.
+//
+// Hooks in queue.h go through LFQ_TRACE, which expands to nothing unless
+// LOCK_FREE_QUEUE_TRACING is defined.
+
+enum class trace_event : std::uint16_t {
+    push_begin,
+    push_end,
+    push_retry,
+    pop_begin,
+    pop_end,
+    pop_empty,
+    pop_retry,
+    free_external_counter,
+    release_ref,
+    node_delete,
+};
+
+inline const char* trace_event_name(trace_event event) {
+    switch (event) {
+        case trace_event::push_begin:
+        case trace_event::push_end: return "push";
+        case trace_event::push_retry: return "push_retry";
+        case trace_event::pop_begin:
+        case trace_event::pop_end:
+        case trace_event::pop_empty: return "pop";
+        case trace_event::pop_retry: return "pop_retry";
+        case trace_event::free_external_counter: return "free_external_counter";
+        case trace_event::release_ref: return "release_ref";
+        case trace_event::node_delete: return "node_delete";
+    }
+    return "?";
+}
+
+struct trace_record {
+    std::uint64_t cycles;
+    std::uint64_t arg;
+    std::uint32_t thread;
+    trace_event event;
+};
+
+class trace_ring {
+private:
+    std::vector<trace_record> records;
+    std::size_t const mask;
+    std::atomic<std::uint64_t> written{0};
+
+public:
+    std::uint32_t const thread;
+
+    trace_ring(std::size_t capacity, std::uint32_t thread_id)
+        : records(capacity), mask(capacity - 1), thread(thread_id) {}
+
+    // Only called by the owning thread.
+    void record(trace_event event, std::uint64_t arg) {
+        std::uint64_t const n = written.load(std::memory_order_relaxed);
+        trace_record& r = records[n & mask];
+        r.cycles = read_cycle_counter();
+        r.arg = arg;
+        r.thread = thread;
+        r.event = event;
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    // Records still held by the ring, oldest first. Take snapshots once the
+    // traced threads are quiescent; a live writer may overwrite entries.
+    std::vector<trace_record> snapshot() const {
+        std::uint64_t const n = written.load(std::memory_order_acquire);
+        std::uint64_t const first = n > records.size() ? n - records.size() : 0;
+        std::vector<trace_record> out;
+        out.reserve(n - first);
+        for (std::uint64_t i = first; i < n; ++i) {
+            out.push_back(records[i & mask]);
+        }
+        return out;
+    }
+
+    void clear() { written.store(0, std::memory_order_release); }
+};
+
+class trace_registry {
+private:
+    std::mutex m;
+    std::vector<std::shared_ptr<trace_ring>> rings;
+    std::size_t ring_capacity = 1 << 16;
+
+public:
+    static trace_registry& instance() {
+        static trace_registry registry;
+        return registry;
+    }
+
+    // Applies to rings created afterwards; must be a power of two.
+    void set_ring_capacity(std::size_t capacity) {
+        std::lock_guard<std::mutex> lock(m);
+        ring_capacity = capacity;
+    }
+
+    std::shared_ptr<trace_ring> create_ring() {
+        std::lock_guard<std::mutex> lock(m);
+        auto ring = std::make_shared<trace_ring>(ring_capacity, static_cast<std::uint32_t>(rings.size() + 1));
+        rings.push_back(ring);
+        return ring;
+    }
+
+    std::vector<std::shared_ptr<trace_ring>> all_rings() {
+        std::lock_guard<std::mutex> lock(m);
+        return rings;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m);
+        for (auto& ring : rings) {
+            ring->clear();
+        }
+    }
+};
+
+inline void record_trace_event(trace_event event, std::uint64_t arg) {
+    thread_local std::shared_ptr<trace_ring> const ring = trace_registry::instance().create_ring();
+    ring->record(event, arg);
+}
+
+// Writes every ring as a Chrome trace event array. push/pop begin-end pairs
+// become duration slices, everything else becomes an instant event carrying
+// its argument (usually a node address).
+inline std::size_t write_chrome_trace(std::ostream& out) {
+    std::vector<trace_record> all;
+    for (const auto& ring : trace_registry::instance().all_rings()) {
+        std::vector<trace_record> const records = ring->snapshot();
+        all.insert(all.end(), records.begin(), records.end());
+    }
+    std::uint64_t base = UINT64_MAX;
+    for (const auto& r : all) {
+        base = r.cycles < base ? r.cycles : base;
+    }
+
+    std::ios_base::fmtflags const flags = out.flags();
+    out.setf(std::ios::fixed);
+    std::streamsize const precision = out.precision(3);
+    out << "[\n";
+    bool first = true;
+    for (const auto& r : all) {
+        char const* phase = "i";
+        switch (r.event) {
+            case trace_event::push_begin:
+            case trace_event::pop_begin: phase = "B"; break;
+            case trace_event::push_end:
+            case trace_event::pop_end:
+            case trace_event::pop_empty: phase = "E"; break;
+            default: break;
+        }
+        out << (first ? "" : ",\n")
+            << "{\"name\":\"" << trace_event_name(r.event) << "\",\"ph\":\"" << phase
+            << "\",\"pid\":1,\"tid\":" << r.thread
+            << ",\"ts\":" << cycles_to_ns(r.cycles - base) / 1000.0;
+        if (*phase == 'i') {
+            out << ",\"s\":\"t\",\"args\":{\"arg\":" << r.arg << "}";
+        } else if (r.event == trace_event::pop_empty) {
+            out << ",\"args\":{\"empty\":true}";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n]\n";
+    out.flags(flags);
+    out.precision(precision);
+    return all.size();
+}
+
+#ifdef LOCK_FREE_QUEUE_TRACING
+#define LFQ_TRACE(event, arg) \
+    ::record_trace_event(::trace_event::event, reinterpret_cast<std::uintptr_t>(arg))
+#else
+#define LFQ_TRACE(event, arg) ((void)0)
+#endif
+
+#endif //TRACE_H
@@ -0,0 +1,118 @@
+//
+// Created by Supradeep Chitumalla on 17/10/26.
+//
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spin_wait.h"
+
+// Arrival schedules for paced producers. A schedule is the list of intended
+// send times, in nanoseconds from the start of the run, one per item.
+using arrival_schedule = std::vector<std::uint64_t>;
+
+inline arrival_schedule constant_rate_arrivals(double items_per_second, std::size_t count) {
+    arrival_schedule schedule(count);
+    double const gap_ns = 1e9 / items_per_second;
+    for (std::size_t i = 0; i < count; ++i) {
+        schedule[i] = static_cast<std::uint64_t>(i * gap_ns);
+    }
+    return schedule;
+}
+
+// Exponentially distributed gaps: independent arrivals at a mean rate.
+inline arrival_schedule poisson_arrivals(double items_per_second, std::size_t count,
+                                         std::uint64_t seed) {
+    arrival_schedule schedule(count);
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap(items_per_second / 1e9);
+    double t = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        t += gap(rng);
+        schedule[i] = static_cast<std::uint64_t>(t);
+    }
+    return schedule;
+}
+
+// Bursts of burst_length items sent at burst_rate, separated by idle gaps long
+// enough for consumers to drain the queue empty.
+inline arrival_schedule on_off_arrivals(double burst_rate, std::size_t burst_length,
+                                        std::chrono::nanoseconds idle, std::size_t count) {
+    arrival_schedule schedule(count);
+    double const gap_ns = 1e9 / burst_rate;
+    double t = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (i > 0 && i % burst_length == 0) {
+            t += static_cast<double>(idle.count());
+        } else if (i > 0) {
+            t += gap_ns;
+        }
+        schedule[i] = static_cast<std::uint64_t>(t);
+    }
+    return schedule;
+}
+
+// Replays a recorded trace: one integer timestamp in nanoseconds per line,
+// blank lines and lines starting with '#' ignored. Timestamps are rebased to
+// the first entry and must not go backwards.
+inline arrival_schedule trace_arrivals(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("cannot open trace file " + path);
+    }
+    arrival_schedule schedule;
+    std::string line;
+    std::uint64_t first = 0;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::uint64_t const stamp = std::stoull(line);
+        if (schedule.empty()) {
+            first = stamp;
+        }
+        if (stamp < first || (!schedule.empty() && stamp - first < schedule.back())) {
+            throw std::runtime_error("trace timestamps go backwards in " + path);
+        }
+        schedule.push_back(stamp - first);
+    }
+    return schedule;
+}
+
+// Splits one schedule round-robin across producers, so several threads
+// together reproduce the aggregate arrival process.
+inline std::vector<arrival_schedule> split_schedule(const arrival_schedule& schedule,
+                                                    int num_producers) {
+    std::vector<arrival_schedule> parts(num_producers);
+    for (std::size_t i = 0; i < schedule.size(); ++i) {
+        parts[i % num_producers].push_back(schedule[i]);
+    }
+    return parts;
+}
+
+// Waits until a point on the steady clock: sleeps while the deadline is far
+// away and spins for the last stretch, which sleep granularity cannot hit.
+inline void wait_until(std::chrono::steady_clock::time_point deadline) {
+    constexpr auto spin_window = std::chrono::microseconds(50);
+    for (;;) {
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return;
+        }
+        if (deadline - now > spin_window) {
+            std::this_thread::sleep_for(deadline - now - spin_window);
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+#endif //WORKLOAD_H